@@ -0,0 +1,602 @@
+#include <string.h>
+
+#include "jpg.h"
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define CLAMP(v, lo, hi) ((v) < (lo) ? (lo) : ((v) > (hi) ? (hi) : (v)))
+
+static const uint8_t zigzag[64] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13, 6,  7,  14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63};
+
+// IDCT basis for 8, 4, 2 and 1 point outputs, c(u) * cos((2x + 1)u pi / 2n)
+// in 4.12 fixed point. The reduced sizes fold in the average over the
+// 8 / n pixels each output covers, so scaled output is box filtered.
+static const int16_t idct8[64] = {
+    4096, 5681,  5352,  4816,  4096,  3218,  2217,  1130,  //
+    4096, 4816,  2217,  -1130, -4096, -5681, -5352, -3218, //
+    4096, 3218,  -2217, -5681, -4096, 1130,  5352,  4816,  //
+    4096, 1130,  -5352, -3218, 4096,  4816,  -2217, -5681, //
+    4096, -1130, -5352, 3218,  4096,  -4816, -2217, 5681,  //
+    4096, -3218, -2217, 5681,  -4096, -1130, 5352,  -4816, //
+    4096, -4816, 2217,  1130,  -4096, 5681,  -5352, 3218,  //
+    4096, -5681, 5352,  -4816, 4096,  -3218, 2217,  -1130};
+static const int16_t idct4[16] = {
+    4096, 5249,  3784,  1843,  //
+    4096, 2174,  -3784, -4450, //
+    4096, -2174, -3784, 4450,  //
+    4096, -5249, 3784,  -1843};
+static const int16_t idct2[4] = {4096, 3711, 4096, -3711};
+static const int16_t idct1[1] = {4096};
+
+//
+// Input
+//
+
+static int read_byte(jpg_t *jpg) {
+  if (jpg->input_pos == jpg->input_len) {
+    jpg->input_len = jpg->read(jpg->ctx, jpg->input, JPG_INPUT_SIZE);
+    jpg->input_pos = 0;
+    if (jpg->input_len == 0) {
+      return -1;
+    }
+  }
+  return jpg->input[jpg->input_pos++];
+}
+
+static int read_u16(jpg_t *jpg) {
+  int hi = read_byte(jpg);
+  int lo = read_byte(jpg);
+  return (hi < 0 || lo < 0) ? -1 : (hi << 8) | lo;
+}
+
+static int skip(jpg_t *jpg, int len) {
+  while (len-- > 0) {
+    if (read_byte(jpg) < 0) {
+      return JPG_ERR_READ;
+    }
+  }
+  return JPG_OK;
+}
+
+// skip to the next marker and return its code, or -1 at the end of input
+static int next_marker(jpg_t *jpg) {
+  int c;
+  do {
+    do {
+      c = read_byte(jpg);
+    } while (c >= 0 && c != 0xFF);
+    do {
+      c = read_byte(jpg);
+    } while (c == 0xFF);
+  } while (c == 0); // stuffed 0xFF data byte
+  return c;
+}
+
+//
+// Headers
+//
+
+static int read_dqt(jpg_t *jpg) {
+  int len = read_u16(jpg) - 2;
+  while (len > 0) {
+    int pq_tq = read_byte(jpg);
+    if (pq_tq < 0) {
+      return JPG_ERR_READ;
+    }
+    bool wide = (pq_tq >> 4) != 0;
+    uint16_t *qt = jpg->qt[pq_tq & 3];
+    for (int i = 0; i < 64; i++) {
+      int v = wide ? read_u16(jpg) : read_byte(jpg);
+      if (v < 0) {
+        return JPG_ERR_READ;
+      }
+      qt[i] = v;
+    }
+    len -= wide ? 129 : 65;
+  }
+  return (len == 0) ? JPG_OK : JPG_ERR_FORMAT;
+}
+
+static int build_huffman(jpg_huffman_t *h, const uint8_t *counts) {
+  // over subscribed codes would run past the end of lookup
+  int left = 1;
+  for (int len = 1; len <= 16; len++) {
+    left = (left << 1) - counts[len];
+    if (left < 0) {
+      return JPG_ERR_FORMAT;
+    }
+  }
+
+  uint16_t code = 0;
+  int k = 0;
+
+  memset(h->lookup, 0, sizeof(h->lookup));
+  for (int len = 1; len <= 16; len++) {
+    h->valptr[len] = k;
+    h->mincode[len] = code;
+    for (int i = 0; i < counts[len]; i++, k++, code++) {
+      if (len <= 8) {
+        // every byte that starts with this code
+        int shift = 8 - len;
+        for (int j = 0; j < (1 << shift); j++) {
+          h->lookup[(code << shift) | j] = (len << 8) | h->symbols[k];
+        }
+      }
+    }
+    h->maxcode[len] = counts[len] ? code - 1 : -1;
+    code <<= 1;
+  }
+  return JPG_OK;
+}
+
+static int read_dht(jpg_t *jpg) {
+  int len = read_u16(jpg) - 2;
+  while (len > 0) {
+    int tc_th = read_byte(jpg);
+    if (tc_th < 0) {
+      return JPG_ERR_READ;
+    }
+    if ((tc_th & 0x0F) > 1 || (tc_th >> 4) > 1) {
+      return JPG_ERR_UNSUPPORTED;
+    }
+    jpg_huffman_t *h =
+        (tc_th >> 4) ? &jpg->ac[tc_th & 1] : &jpg->dc[tc_th & 1];
+
+    uint8_t counts[17];
+    int total = 0;
+    for (int i = 1; i <= 16; i++) {
+      int c = read_byte(jpg);
+      if (c < 0) {
+        return JPG_ERR_READ;
+      }
+      counts[i] = c;
+      total += c;
+    }
+    if (total > 256) {
+      return JPG_ERR_FORMAT;
+    }
+    for (int i = 0; i < total; i++) {
+      int c = read_byte(jpg);
+      if (c < 0) {
+        return JPG_ERR_READ;
+      }
+      h->symbols[i] = c;
+    }
+    int result = build_huffman(h, counts);
+    if (result != JPG_OK) {
+      return result;
+    }
+    len -= 17 + total;
+  }
+  return (len == 0) ? JPG_OK : JPG_ERR_FORMAT;
+}
+
+static int read_sof(jpg_t *jpg) {
+  if (read_u16(jpg) < 0) {
+    return JPG_ERR_READ;
+  }
+  if (read_byte(jpg) != 8) {
+    return JPG_ERR_UNSUPPORTED;
+  }
+  int height = read_u16(jpg);
+  int width = read_u16(jpg);
+  int ncomponents = read_byte(jpg);
+  if (height < 0 || width < 0 || ncomponents < 0) {
+    return JPG_ERR_READ;
+  }
+  if (height == 0 || width == 0) {
+    return JPG_ERR_FORMAT;
+  }
+  if (ncomponents != 1 && ncomponents != 3) {
+    return JPG_ERR_UNSUPPORTED;
+  }
+
+  jpg->width = width;
+  jpg->height = height;
+  jpg->ncomponents = ncomponents;
+  jpg->hmax = 1;
+  jpg->vmax = 1;
+  for (int i = 0; i < ncomponents; i++) {
+    jpg_component_t *comp = &jpg->components[i];
+    int id = read_byte(jpg);
+    int hv = read_byte(jpg);
+    int tq = read_byte(jpg);
+    if (id < 0 || hv < 0 || tq < 0) {
+      return JPG_ERR_READ;
+    }
+    comp->id = id;
+    comp->h = hv >> 4;
+    comp->v = hv & 0x0F;
+    comp->tq = tq & 3;
+    if (comp->h < 1 || comp->h > 2 || comp->v < 1 || comp->v > 2) {
+      return JPG_ERR_UNSUPPORTED;
+    }
+    if (ncomponents == 1) {
+      // a single component scan has one block per MCU
+      comp->h = comp->v = 1;
+    }
+    jpg->hmax = comp->h > jpg->hmax ? comp->h : jpg->hmax;
+    jpg->vmax = comp->v > jpg->vmax ? comp->v : jpg->vmax;
+  }
+  return JPG_OK;
+}
+
+static int read_sos(jpg_t *jpg) {
+  if (read_u16(jpg) < 0) {
+    return JPG_ERR_READ;
+  }
+  int ns = read_byte(jpg);
+  if (ns < 0) {
+    return JPG_ERR_READ;
+  }
+  if (ns != jpg->ncomponents) {
+    return JPG_ERR_UNSUPPORTED; // multiple scans
+  }
+
+  // order the components as the scan interleaves them
+  for (int i = 0; i < ns; i++) {
+    int id = read_byte(jpg);
+    int tables = read_byte(jpg);
+    if (id < 0 || tables < 0) {
+      return JPG_ERR_READ;
+    }
+    int j = i;
+    while (j < ns && jpg->components[j].id != id) {
+      j++;
+    }
+    if (j == ns || (tables >> 4) > 1 || (tables & 0x0F) > 1) {
+      return JPG_ERR_FORMAT;
+    }
+    jpg_component_t comp = jpg->components[j];
+    jpg->components[j] = jpg->components[i];
+    jpg->components[i] = comp;
+    jpg->components[i].td = tables >> 4;
+    jpg->components[i].ta = tables & 0x0F;
+  }
+  return skip(jpg, 3); // spectral selection and approximation
+}
+
+int jpg_open(jpg_t *jpg, jpg_read_t read, void *ctx) {
+  jpg->read = read;
+  jpg->ctx = ctx;
+  jpg->input_pos = 0;
+  jpg->input_len = 0;
+  jpg->width = 0;
+  jpg->height = 0;
+  jpg->restart_interval = 0;
+  memset(jpg->dc, 0, sizeof(jpg->dc));
+  memset(jpg->ac, 0, sizeof(jpg->ac));
+
+  if (read_byte(jpg) != 0xFF || read_byte(jpg) != 0xD8) {
+    return JPG_ERR_FORMAT;
+  }
+
+  for (;;) {
+    int marker = next_marker(jpg);
+    int result = JPG_OK;
+    switch (marker) {
+    case -1:
+      return JPG_ERR_READ;
+    case 0xC0: // baseline
+    case 0xC1: // extended sequential, huffman
+      result = read_sof(jpg);
+      break;
+    case 0xC2:
+    case 0xC3:
+    case 0xC5:
+    case 0xC6:
+    case 0xC7:
+    case 0xC9:
+    case 0xCA:
+    case 0xCB:
+    case 0xCD:
+    case 0xCE:
+    case 0xCF:
+      return JPG_ERR_UNSUPPORTED;
+    case 0xC4:
+      result = read_dht(jpg);
+      break;
+    case 0xDB:
+      result = read_dqt(jpg);
+      break;
+    case 0xDD:
+      if (read_u16(jpg) != 4) {
+        return JPG_ERR_FORMAT;
+      }
+      result = read_u16(jpg);
+      if (result < 0) {
+        return JPG_ERR_READ;
+      }
+      jpg->restart_interval = result;
+      result = JPG_OK;
+      break;
+    case 0xDA:
+      if (jpg->width == 0) {
+        return JPG_ERR_FORMAT;
+      }
+      return read_sos(jpg);
+    case 0xD9:
+      return JPG_ERR_FORMAT;
+    default: {
+      int len = read_u16(jpg);
+      result = (len < 2) ? JPG_ERR_FORMAT : skip(jpg, len - 2);
+      break;
+    }
+    }
+    if (result != JPG_OK) {
+      return result;
+    }
+  }
+}
+
+//
+// Entropy decoding
+//
+
+static void fill_bits(jpg_t *jpg) {
+  while (jpg->nbits <= 24) {
+    int c = 0;
+    if (jpg->marker == 0) {
+      c = read_byte(jpg);
+      if (c < 0) {
+        jpg->marker = -1;
+        c = 0;
+      } else if (c == 0xFF) {
+        int next;
+        do {
+          next = read_byte(jpg);
+        } while (next == 0xFF);
+        if (next != 0) {
+          // pad with zeros from here on
+          jpg->marker = next;
+          c = 0;
+        }
+      }
+    }
+    jpg->bits |= (uint32_t)c << (24 - jpg->nbits);
+    jpg->nbits += 8;
+  }
+}
+
+static inline int get_bits(jpg_t *jpg, int n) {
+  if (n == 0) {
+    return 0;
+  }
+  if (jpg->nbits < n) {
+    fill_bits(jpg);
+  }
+  int v = jpg->bits >> (32 - n);
+  jpg->bits <<= n;
+  jpg->nbits -= n;
+  return v;
+}
+
+static inline int extend(int v, int n) {
+  return (v < (1 << (n - 1))) ? v - (1 << n) + 1 : v;
+}
+
+static int decode_huffman(jpg_t *jpg, const jpg_huffman_t *h) {
+  if (jpg->nbits < 16) {
+    fill_bits(jpg);
+  }
+
+  int entry = h->lookup[jpg->bits >> 24];
+  if (entry) {
+    int len = entry >> 8;
+    jpg->bits <<= len;
+    jpg->nbits -= len;
+    return entry & 0xFF;
+  }
+
+  for (int len = 9; len <= 16; len++) {
+    int32_t code = jpg->bits >> (32 - len);
+    if (code <= h->maxcode[len]) {
+      jpg->bits <<= len;
+      jpg->nbits -= len;
+      return h->symbols[(h->valptr[len] + code - h->mincode[len]) & 0xFF];
+    }
+  }
+  return -1;
+}
+
+static int decode_block(jpg_t *jpg, jpg_component_t *comp) {
+  int16_t *coef = jpg->coef;
+  const uint16_t *qt = jpg->qt[comp->tq];
+
+  memset(coef, 0, sizeof(jpg->coef));
+
+  int s = decode_huffman(jpg, &jpg->dc[comp->td]);
+  if (s < 0 || s > 11) {
+    return JPG_ERR_FORMAT;
+  }
+  comp->pred += s ? extend(get_bits(jpg, s), s) : 0;
+  int dc = CLAMP(comp->pred, -2047, 2047) * qt[0];
+  coef[0] = CLAMP(dc, -4095, 4095);
+
+  for (int k = 1; k < 64;) {
+    int rs = decode_huffman(jpg, &jpg->ac[comp->ta]);
+    if (rs < 0) {
+      return JPG_ERR_FORMAT;
+    }
+    int r = rs >> 4;
+    s = rs & 0x0F;
+    if (s == 0) {
+      if (r != 15) {
+        break; // end of block
+      }
+      k += 16;
+      continue;
+    }
+    k += r;
+    if (k > 63 || s > 10) {
+      return JPG_ERR_FORMAT;
+    }
+    // coefficients of real images stay well inside 12 bits, the clamp keeps
+    // corrupt data from overflowing the IDCT
+    int value = extend(get_bits(jpg, s), s) * qt[k];
+    coef[zigzag[k++]] = CLAMP(value, -4095, 4095);
+  }
+  return JPG_OK;
+}
+
+static const int16_t *idct_table(int n) {
+  return (n == 8) ? idct8 : (n == 4) ? idct4 : (n == 2) ? idct2 : idct1;
+}
+
+// inverse DCT of the top left nv by nh coefficients into nh wide, nv high
+// samples
+static void idct(jpg_t *jpg, uint8_t *out, int stride, int nh, int nv) {
+  const int16_t *th = idct_table(nh);
+  const int16_t *tv = idct_table(nv);
+  const int16_t *coef = jpg->coef;
+  int32_t tmp[64];
+
+  for (int v = 0; v < nv; v++) {
+    for (int x = 0; x < nh; x++) {
+      int32_t sum = 0;
+      for (int u = 0; u < nh; u++) {
+        sum += th[x * nh + u] * coef[v * 8 + u];
+      }
+      tmp[v * 8 + x] = (sum + 2048) >> 12;
+    }
+  }
+  for (int y = 0; y < nv; y++) {
+    for (int x = 0; x < nh; x++) {
+      int32_t sum = 0;
+      for (int v = 0; v < nv; v++) {
+        sum += tv[y * nv + v] * tmp[v * 8 + x];
+      }
+      int value = ((sum + (1 << 14)) >> 15) + 128;
+      out[y * stride + x] = CLAMP(value, 0, 255);
+    }
+  }
+}
+
+// IDCT size of a component, subsampled components are decoded at up to
+// full size before being upsampled by repetition
+static inline int component_width(jpg_t *jpg, const jpg_component_t *comp) {
+  return MIN(8, jpg->scale * jpg->hmax / comp->h);
+}
+
+static inline int component_height(jpg_t *jpg, const jpg_component_t *comp) {
+  return MIN(8, jpg->scale * jpg->vmax / comp->v);
+}
+
+// convert the MCU samples to RGB565
+static void mcu_to_rgb565(jpg_t *jpg) {
+  int mw = jpg->hmax * jpg->scale;
+  int mh = jpg->vmax * jpg->scale;
+  uint16_t *out = jpg->pixels;
+
+  if (jpg->ncomponents == 1) {
+    for (int i = 0; i < mw * mh; i++) {
+      uint8_t y = jpg->samples[0][i];
+      out[i] = ((y & 0xF8) << 8) | ((y & 0xFC) << 3) | (y >> 3);
+    }
+    return;
+  }
+
+  // sample plane sizes of each component
+  int pw[3], ph[3];
+  for (int i = 0; i < 3; i++) {
+    pw[i] = jpg->components[i].h * component_width(jpg, &jpg->components[i]);
+    ph[i] = jpg->components[i].v * component_height(jpg, &jpg->components[i]);
+  }
+
+  for (int py = 0; py < mh; py++) {
+    const uint8_t *ys = &jpg->samples[0][(py * ph[0] / mh) * pw[0]];
+    const uint8_t *cbs = &jpg->samples[1][(py * ph[1] / mh) * pw[1]];
+    const uint8_t *crs = &jpg->samples[2][(py * ph[2] / mh) * pw[2]];
+    for (int px = 0; px < mw; px++) {
+      int y = ys[px * pw[0] / mw];
+      int cb = cbs[px * pw[1] / mw] - 128;
+      int cr = crs[px * pw[2] / mw] - 128;
+      int r = y + ((91881 * cr + 32768) >> 16);
+      int g = y - ((22554 * cb + 46802 * cr + 32768) >> 16);
+      int b = y + ((116130 * cb + 32768) >> 16);
+      r = CLAMP(r, 0, 255);
+      g = CLAMP(g, 0, 255);
+      b = CLAMP(b, 0, 255);
+      *out++ = ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+    }
+  }
+}
+
+static int restart(jpg_t *jpg) {
+  if (jpg->marker == 0) {
+    jpg->marker = next_marker(jpg);
+  }
+  if (jpg->marker < 0xD0 || jpg->marker > 0xD7) {
+    return (jpg->marker < 0) ? JPG_ERR_READ : JPG_ERR_FORMAT;
+  }
+  jpg->marker = 0;
+  jpg->bits = 0;
+  jpg->nbits = 0;
+  for (int i = 0; i < jpg->ncomponents; i++) {
+    jpg->components[i].pred = 0;
+  }
+  return JPG_OK;
+}
+
+int jpg_decode(jpg_t *jpg, int scale, jpg_write_t write, void *ctx) {
+  if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+    return JPG_ERR_UNSUPPORTED;
+  }
+  int n = 8 / scale;
+  jpg->scale = n;
+  jpg->write = write;
+  jpg->bits = 0;
+  jpg->nbits = 0;
+  jpg->marker = 0;
+  for (int i = 0; i < jpg->ncomponents; i++) {
+    jpg->components[i].pred = 0;
+  }
+
+  int mcu_w = 8 * jpg->hmax, mcu_h = 8 * jpg->vmax;
+  int mcus_x = (jpg->width + mcu_w - 1) / mcu_w;
+  int mcus_y = (jpg->height + mcu_h - 1) / mcu_h;
+  int out_w = (jpg->width * n + 7) / 8;
+  int out_h = (jpg->height * n + 7) / 8;
+  int mw = jpg->hmax * n, mh = jpg->vmax * n;
+  int todo = jpg->restart_interval;
+
+  for (int my = 0; my < mcus_y; my++) {
+    for (int mx = 0; mx < mcus_x; mx++) {
+      if (jpg->restart_interval) {
+        if (todo == 0) {
+          int result = restart(jpg);
+          if (result != JPG_OK) {
+            return result;
+          }
+          todo = jpg->restart_interval;
+        }
+        todo--;
+      }
+
+      for (int i = 0; i < jpg->ncomponents; i++) {
+        jpg_component_t *comp = &jpg->components[i];
+        int nh = component_width(jpg, comp);
+        int nv = component_height(jpg, comp);
+        int stride = comp->h * nh;
+        for (int by = 0; by < comp->v; by++) {
+          for (int bx = 0; bx < comp->h; bx++) {
+            int result = decode_block(jpg, comp);
+            if (result != JPG_OK) {
+              return result;
+            }
+            idct(jpg, &jpg->samples[i][by * nv * stride + bx * nh], stride,
+                 nh, nv);
+          }
+        }
+      }
+      mcu_to_rgb565(jpg);
+      int x = mx * mw, y = my * mh;
+      write(ctx, x, y, MIN(mw, out_w - x), MIN(mh, out_h - y), jpg->pixels,
+            mw);
+    }
+  }
+  return JPG_OK;
+}
@@ -0,0 +1,87 @@
+#ifndef __JPG_H__
+#define __JPG_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming baseline JPEG decoder. Input is pulled through a read callback
+// and output is handed over one MCU at a time, so memory use stays at the
+// size of jpg_t whatever the size of the image.
+
+#define JPG_INPUT_SIZE 512 // bytes read from the source at a time
+
+// decoder results
+#define JPG_OK 0
+#define JPG_ERR_READ 1        // source ended early
+#define JPG_ERR_FORMAT 2      // not a JPEG or corrupt data
+#define JPG_ERR_UNSUPPORTED 3 // progressive, arithmetic or 12 bit images
+
+// returns the number of bytes read into buf, 0 at the end of the source
+typedef size_t (*jpg_read_t)(void *ctx, uint8_t *buf, size_t len);
+
+// receives w by h RGB565 pixels for the area at x, y of the scaled image,
+// rows are stride pixels apart
+typedef void (*jpg_write_t)(void *ctx, int x, int y, int w, int h,
+                            const uint16_t *pixels, int stride);
+
+typedef struct _jpg_huffman_t {
+  uint16_t lookup[256];  // 8 bit prefix to (length << 8) | symbol, 0 if longer
+  int32_t maxcode[18];   // largest code of each length, -1 if none
+  int16_t valptr[17];    // index of the first symbol of each length
+  uint16_t mincode[17];  // smallest code of each length
+  uint8_t symbols[256];
+} jpg_huffman_t;
+
+typedef struct _jpg_component_t {
+  uint8_t id;
+  uint8_t h, v;  // sampling factors
+  uint8_t tq;    // quantization table
+  uint8_t td;    // DC huffman table
+  uint8_t ta;    // AC huffman table
+  int16_t pred;  // DC predictor
+} jpg_component_t;
+
+typedef struct _jpg_t {
+  jpg_read_t read;
+  jpg_write_t write;
+  void *ctx;
+
+  uint8_t input[JPG_INPUT_SIZE];
+  size_t input_pos;
+  size_t input_len;
+
+  uint32_t bits; // entropy coded bits, MSB first
+  int nbits;
+  int marker; // marker that ended the entropy coded data, -1 at end of input
+
+  uint16_t qt[4][64]; // quantization tables, zigzag order
+  jpg_huffman_t dc[2];
+  jpg_huffman_t ac[2];
+  jpg_component_t components[3];
+  uint8_t ncomponents;
+  uint8_t hmax, vmax;
+  uint16_t width, height;
+  uint16_t restart_interval;
+
+  uint8_t scale; // IDCT size, 8 for full size down to 1 for 1/8
+  int16_t coef[64]; // dequantized coefficients, natural order
+  uint8_t samples[3][256]; // one MCU of each component, scaled
+  uint16_t pixels[256];    // one MCU of RGB565 output
+} jpg_t;
+
+// read the headers up to the start of the image data, sets width and height
+int jpg_open(jpg_t *jpg, jpg_read_t read, void *ctx);
+
+// decode the image at 1/scale size, scale is 1, 2, 4 or 8
+int jpg_decode(jpg_t *jpg, int scale, jpg_write_t write, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif /*  __cplusplus */
+
+#endif /*  __JPG_H__ */
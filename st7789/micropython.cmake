@@ -3,7 +3,9 @@ add_library(usermod_st7789 INTERFACE)
 
 # Add our source files to the lib
 target_sources(usermod_st7789 INTERFACE
-    ${CMAKE_CURRENT_LIST_DIR}/st7789.c)
+    ${CMAKE_CURRENT_LIST_DIR}/st7789.c
+    ${CMAKE_CURRENT_LIST_DIR}/jpg.c
+    ${CMAKE_CURRENT_LIST_DIR}/png.c)
 
 # Add the current directory as an include directory.
 target_include_directories(usermod_st7789 INTERFACE
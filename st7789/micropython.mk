@@ -1,5 +1,5 @@
 ST7789_MOD_DIR := $(USERMOD_DIR)
 
-SRC_USERMOD += $(addprefix $(ST7789_MOD_DIR)/, st7789.c)
+SRC_USERMOD += $(addprefix $(ST7789_MOD_DIR)/, st7789.c jpg.c png.c)
 
 CFLAGS_USERMOD += -I$(ST7789_MOD_DIR)
@@ -0,0 +1,681 @@
+#include <string.h>
+
+#include "png.h"
+
+#define CHUNK(a, b, c, d)                                                      \
+  (((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (d))
+#define CHUNK_IHDR CHUNK('I', 'H', 'D', 'R')
+#define CHUNK_PLTE CHUNK('P', 'L', 'T', 'E')
+#define CHUNK_TRNS CHUNK('t', 'R', 'N', 'S')
+#define CHUNK_IDAT CHUNK('I', 'D', 'A', 'T')
+#define CHUNK_IEND CHUNK('I', 'E', 'N', 'D')
+
+// bytes the inflater may read ahead of the end of the compressed data
+#define MAX_PADDING 4
+
+static const uint8_t signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+// order of the code length code lengths in a dynamic block header
+static const uint8_t code_order[19] = {16, 17, 18, 0, 8,  7, 9,  6, 10, 5,
+                                       11, 4,  12, 3, 13, 2, 14, 1, 15};
+
+static const uint16_t length_base[29] = {
+    3,  4,  5,  6,  7,  8,  9,  10, 11,  13,  15,  17,  19,  23, 27,
+    31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const uint8_t length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                         1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                         4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const uint16_t dist_base[30] = {
+    1,   2,   3,   4,   5,   7,    9,    13,   17,   25,   33,   49,   65,
+    97,  129, 193, 257, 385, 513,  769,  1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577};
+static const uint8_t dist_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2,  3,  3,
+                                       4, 4, 5, 5, 6, 6, 7, 7,  8,  8,
+                                       9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static inline uint16_t rgb565(int r, int g, int b) {
+  return ((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3);
+}
+
+//
+// Input
+//
+
+static int read_byte(png_t *png) {
+  if (png->input_pos == png->input_len) {
+    png->input_len = png->read(png->ctx, png->input, PNG_INPUT_SIZE);
+    png->input_pos = 0;
+    if (png->input_len == 0) {
+      return -1;
+    }
+  }
+  return png->input[png->input_pos++];
+}
+
+static bool read_u32(png_t *png, uint32_t *value) {
+  *value = 0;
+  for (int i = 0; i < 4; i++) {
+    int c = read_byte(png);
+    if (c < 0) {
+      return false;
+    }
+    *value = (*value << 8) | c;
+  }
+  return true;
+}
+
+static int skip(png_t *png, uint32_t len) {
+  while (len-- > 0) {
+    if (read_byte(png) < 0) {
+      return PNG_ERR_READ;
+    }
+  }
+  return PNG_OK;
+}
+
+// next byte of the zlib stream, which carries on across IDAT chunks, or -1
+// at the end of the image data
+static int read_data(png_t *png) {
+  while (png->chunk_left == 0) {
+    uint32_t len, type;
+    if (png->padding || skip(png, 4) != PNG_OK || !read_u32(png, &len) ||
+        !read_u32(png, &type) || type != CHUNK_IDAT) {
+      return -1;
+    }
+    png->chunk_left = len;
+  }
+  int c = read_byte(png);
+  if (c >= 0) {
+    png->chunk_left--;
+  }
+  return c;
+}
+
+//
+// Headers
+//
+
+static int read_ihdr(png_t *png, uint32_t len) {
+  uint8_t ihdr[13];
+  if (len != sizeof(ihdr)) {
+    return PNG_ERR_FORMAT;
+  }
+  for (size_t i = 0; i < sizeof(ihdr); i++) {
+    int c = read_byte(png);
+    if (c < 0) {
+      return PNG_ERR_READ;
+    }
+    ihdr[i] = c;
+  }
+
+  uint32_t width = CHUNK(ihdr[0], ihdr[1], ihdr[2], ihdr[3]);
+  uint32_t height = CHUNK(ihdr[4], ihdr[5], ihdr[6], ihdr[7]);
+  uint8_t depth = ihdr[8];
+  uint8_t color_type = ihdr[9];
+
+  // bit depths allowed for each color type
+  static const uint8_t depths[7] = {0x1F, 0, 0x18, 0x0F, 0x18, 0, 0x18};
+  static const uint8_t channels[7] = {1, 0, 3, 1, 2, 0, 4};
+  int depth_bit = (depth == 1)    ? 0x01
+                  : (depth == 2)  ? 0x02
+                  : (depth == 4)  ? 0x04
+                  : (depth == 8)  ? 0x08
+                  : (depth == 16) ? 0x10
+                                  : 0;
+  if (width == 0 || height == 0 || color_type > 6 ||
+      !(depths[color_type] & depth_bit) || ihdr[10] != 0 || ihdr[11] != 0 ||
+      ihdr[12] > 1) {
+    return PNG_ERR_FORMAT;
+  }
+  if (width > 0xFFFF || height > 0xFFFF || ihdr[12] != 0) {
+    return PNG_ERR_UNSUPPORTED;
+  }
+
+  png->width = width;
+  png->height = height;
+  png->depth = depth;
+  png->color_type = color_type;
+  png->channels = channels[color_type];
+  png->bpp = (png->channels * depth >= 8) ? png->channels * depth / 8 : 1;
+  png->row_bytes = ((size_t)width * png->channels * depth + 7) / 8;
+  png->has_alpha = (color_type & 4) != 0;
+  return PNG_OK;
+}
+
+static int read_plte(png_t *png, uint32_t len) {
+  if (len % 3 || len > 3 * 256) {
+    return PNG_ERR_FORMAT;
+  }
+  for (uint32_t i = 0; i < len / 3; i++) {
+    int r = read_byte(png);
+    int g = read_byte(png);
+    int b = read_byte(png);
+    if (b < 0) {
+      return PNG_ERR_READ;
+    }
+    png->palette[i] = rgb565(r, g, b);
+  }
+  return PNG_OK;
+}
+
+static int read_trns(png_t *png, uint32_t len) {
+  if (png->color_type == 3) {
+    if (len > 256) {
+      return PNG_ERR_FORMAT;
+    }
+    for (uint32_t i = 0; i < len; i++) {
+      int c = read_byte(png);
+      if (c < 0) {
+        return PNG_ERR_READ;
+      }
+      png->palette_alpha[i] = c;
+    }
+  } else if (png->color_type == 0 || png->color_type == 2) {
+    uint32_t samples = (png->color_type == 0) ? 1 : 3;
+    if (len != samples * 2) {
+      return PNG_ERR_FORMAT;
+    }
+    for (uint32_t i = 0; i < samples; i++) {
+      int hi = read_byte(png);
+      int lo = read_byte(png);
+      if (lo < 0) {
+        return PNG_ERR_READ;
+      }
+      png->key[i] = (hi << 8) | lo;
+    }
+    png->has_key = true;
+  } else {
+    // images with an alpha channel have no use for tRNS
+    return skip(png, len);
+  }
+  png->has_alpha = true;
+  return PNG_OK;
+}
+
+static int read_zlib_header(png_t *png) {
+  int cmf = read_data(png);
+  int flg = read_data(png);
+  if (flg < 0) {
+    return PNG_ERR_READ;
+  }
+  // deflate with at most a 32K window, no preset dictionary
+  if ((cmf & 0x0F) != 8 || (cmf >> 4) > 7 || ((cmf << 8) | flg) % 31 ||
+      (flg & 0x20)) {
+    return PNG_ERR_FORMAT;
+  }
+  png->window_mask = (1u << ((cmf >> 4) + 8)) - 1;
+  png->work_size = png->width * sizeof(uint16_t) + png->window_mask + 1 +
+                   2 * (png->row_bytes + 1) + (png->has_alpha ? png->width : 0);
+  return PNG_OK;
+}
+
+int png_open(png_t *png, png_read_t read, void *ctx) {
+  memset(png, 0, sizeof(png_t));
+  memset(png->palette_alpha, 0xFF, sizeof(png->palette_alpha));
+  png->read = read;
+  png->ctx = ctx;
+
+  for (size_t i = 0; i < sizeof(signature); i++) {
+    int c = read_byte(png);
+    if (c < 0) {
+      return PNG_ERR_READ;
+    }
+    if (c != signature[i]) {
+      return PNG_ERR_FORMAT;
+    }
+  }
+
+  for (bool first = true;; first = false) {
+    uint32_t len, type;
+    if (!read_u32(png, &len) || !read_u32(png, &type)) {
+      return PNG_ERR_READ;
+    }
+    if (first != (type == CHUNK_IHDR)) {
+      return PNG_ERR_FORMAT;
+    }
+
+    int result;
+    switch (type) {
+    case CHUNK_IHDR:
+      result = read_ihdr(png, len);
+      break;
+    case CHUNK_PLTE:
+      result = read_plte(png, len);
+      break;
+    case CHUNK_TRNS:
+      result = read_trns(png, len);
+      break;
+    case CHUNK_IDAT:
+      png->chunk_left = len;
+      return read_zlib_header(png);
+    case CHUNK_IEND:
+      return PNG_ERR_FORMAT;
+    default:
+      result = skip(png, len);
+      break;
+    }
+    if (result == PNG_OK) {
+      result = skip(png, 4); // CRC
+    }
+    if (result != PNG_OK) {
+      return result;
+    }
+  }
+}
+
+//
+// Inflate
+//
+
+static void fill_bits(png_t *png) {
+  while (png->nbits <= 24) {
+    int c = read_data(png);
+    if (c < 0) {
+      // feed zeros past the end, the callers check padding
+      c = 0;
+      if (png->padding < 0xFF) {
+        png->padding++;
+      }
+    }
+    png->bits |= (uint32_t)c << png->nbits;
+    png->nbits += 8;
+  }
+}
+
+static inline int get_bits(png_t *png, int n) {
+  if (png->nbits < n) {
+    fill_bits(png);
+  }
+  int v = png->bits & ((1u << n) - 1);
+  png->bits >>= n;
+  png->nbits -= n;
+  return v;
+}
+
+static int build_huffman(png_huffman_t *h, const uint8_t *lengths, int n) {
+  memset(h->counts, 0, sizeof(h->counts));
+  for (int i = 0; i < n; i++) {
+    h->counts[lengths[i]]++;
+  }
+  h->counts[0] = 0;
+
+  // incomplete codes are allowed, over subscribed ones are not
+  int left = 1;
+  uint16_t offsets[16];
+  offsets[1] = 0;
+  for (int len = 1; len < 16; len++) {
+    left = (left << 1) - h->counts[len];
+    if (left < 0) {
+      return PNG_ERR_FORMAT;
+    }
+    if (len < 15) {
+      offsets[len + 1] = offsets[len] + h->counts[len];
+    }
+  }
+  for (int i = 0; i < n; i++) {
+    if (lengths[i]) {
+      h->symbols[offsets[lengths[i]]++] = i;
+    }
+  }
+
+  // codes are sent MSB first in an LSB first stream, so the lookup is
+  // indexed by the bit reversed code
+  memset(h->lookup, 0, sizeof(h->lookup));
+  unsigned code = 0;
+  int k = 0;
+  for (int len = 1; len <= 8; len++) {
+    for (int i = 0; i < h->counts[len]; i++, k++, code++) {
+      unsigned reversed = 0;
+      for (int b = 0; b < len; b++) {
+        reversed |= ((code >> b) & 1) << (len - 1 - b);
+      }
+      for (unsigned j = reversed; j < 256; j += 1u << len) {
+        h->lookup[j] = (len << 9) | h->symbols[k];
+      }
+    }
+    code <<= 1;
+  }
+  return PNG_OK;
+}
+
+static int decode_symbol(png_t *png, const png_huffman_t *h) {
+  fill_bits(png);
+  uint16_t entry = h->lookup[png->bits & 0xFF];
+  if (entry) {
+    int len = entry >> 9;
+    png->bits >>= len;
+    png->nbits -= len;
+    return entry & 0x1FF;
+  }
+
+  // codes longer than 8 bits, one bit at a time
+  int code = 0, first = 0, index = 0;
+  for (int len = 1; len < 16; len++) {
+    code |= png->bits & 1;
+    png->bits >>= 1;
+    png->nbits--;
+    int count = h->counts[len];
+    if (code - first < count) {
+      return h->symbols[index + code - first];
+    }
+    index += count;
+    first = (first + count) << 1;
+    code <<= 1;
+  }
+  return -1;
+}
+
+static inline int paeth(int a, int b, int c) {
+  int pa = b > c ? b - c : c - b;
+  int pb = a > c ? a - c : c - a;
+  int pc = a + b - 2 * c;
+  pc = pc < 0 ? -pc : pc;
+  return (pa <= pb && pa <= pc) ? a : (pb <= pc) ? b : c;
+}
+
+static int unfilter(png_t *png) {
+  uint8_t *row = png->row + 1;
+  const uint8_t *prev = png->prev + 1;
+  size_t n = png->row_bytes, bpp = png->bpp;
+
+  switch (png->row[0]) {
+  case 0: // none
+    break;
+  case 1: // sub
+    for (size_t i = bpp; i < n; i++) {
+      row[i] += row[i - bpp];
+    }
+    break;
+  case 2: // up
+    for (size_t i = 0; i < n; i++) {
+      row[i] += prev[i];
+    }
+    break;
+  case 3: // average
+    for (size_t i = 0; i < bpp; i++) {
+      row[i] += prev[i] >> 1;
+    }
+    for (size_t i = bpp; i < n; i++) {
+      row[i] += (row[i - bpp] + prev[i]) >> 1;
+    }
+    break;
+  case 4: // paeth
+    for (size_t i = 0; i < bpp; i++) {
+      row[i] += prev[i];
+    }
+    for (size_t i = bpp; i < n; i++) {
+      row[i] += paeth(row[i - bpp], prev[i], prev[i - bpp]);
+    }
+    break;
+  default:
+    return PNG_ERR_FORMAT;
+  }
+  return PNG_OK;
+}
+
+// sample i of a row at the given bit depth
+static inline int sample(const uint8_t *row, size_t i, int depth) {
+  switch (depth) {
+  case 8:
+    return row[i];
+  case 16:
+    return (row[2 * i] << 8) | row[2 * i + 1];
+  default: {
+    size_t bit = i * depth;
+    return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+  }
+  }
+}
+
+static inline int sample8(int v, int depth) {
+  return (depth == 16) ? v >> 8 : (depth == 8) ? v : v * 255 / ((1 << depth) - 1);
+}
+
+static void convert_row(png_t *png) {
+  const uint8_t *row = png->row + 1;
+  int depth = png->depth;
+
+  for (int x = 0; x < png->width; x++) {
+    size_t i = (size_t)x * png->channels;
+    int v = sample(row, i, depth);
+    int a = 0xFF;
+
+    if (png->color_type == 3) {
+      png->pixels[x] = png->palette[v];
+      a = png->palette_alpha[v];
+    } else if (png->color_type & 2) {
+      int g = sample(row, i + 1, depth);
+      int b = sample(row, i + 2, depth);
+      png->pixels[x] = rgb565(sample8(v, depth), sample8(g, depth),
+                              sample8(b, depth));
+      if (png->color_type & 4) {
+        a = sample8(sample(row, i + 3, depth), depth);
+      } else if (png->has_key && v == png->key[0] && g == png->key[1] &&
+                 b == png->key[2]) {
+        a = 0;
+      }
+    } else {
+      int gray = sample8(v, depth);
+      png->pixels[x] = rgb565(gray, gray, gray);
+      if (png->color_type & 4) {
+        a = sample8(sample(row, i + 1, depth), depth);
+      } else if (png->has_key && v == png->key[0]) {
+        a = 0;
+      }
+    }
+    if (png->has_alpha) {
+      png->alpha[x] = a;
+    }
+  }
+}
+
+// add a byte of inflated data to the window and the current scanline
+static int put_byte(png_t *png, uint8_t c) {
+  png->window[png->window_pos++ & png->window_mask] = c;
+  png->row[png->row_pos++] = c;
+  if (png->row_pos <= png->row_bytes) {
+    return PNG_OK;
+  }
+
+  int result = unfilter(png);
+  if (result != PNG_OK) {
+    return result;
+  }
+  convert_row(png);
+  png->write(png->write_ctx, png->y, png->pixels,
+             png->has_alpha ? png->alpha : NULL, png->width);
+
+  uint8_t *row = png->row;
+  png->row = png->prev;
+  png->prev = row;
+  png->row_pos = 0;
+  png->y++;
+  return PNG_OK;
+}
+
+static inline bool rows_done(png_t *png) {
+  return png->y == png->height;
+}
+
+static int inflate_stored(png_t *png) {
+  // stored blocks start on a byte boundary
+  get_bits(png, png->nbits & 7);
+  int len = get_bits(png, 16);
+  int nlen = get_bits(png, 16);
+  if (len != (~nlen & 0xFFFF)) {
+    return PNG_ERR_FORMAT;
+  }
+  while (len-- > 0 && !rows_done(png)) {
+    int result = put_byte(png, get_bits(png, 8));
+    if (result != PNG_OK) {
+      return result;
+    }
+    if (png->padding > MAX_PADDING) {
+      return PNG_ERR_READ;
+    }
+  }
+  return PNG_OK;
+}
+
+static int inflate_codes(png_t *png) {
+  for (;;) {
+    if (png->padding > MAX_PADDING) {
+      return PNG_ERR_READ;
+    }
+    int symbol = decode_symbol(png, &png->lit);
+    if (symbol < 256) {
+      if (symbol < 0) {
+        return PNG_ERR_FORMAT;
+      }
+      int result = put_byte(png, symbol);
+      if (result != PNG_OK || rows_done(png)) {
+        return result;
+      }
+    } else if (symbol == 256) {
+      return PNG_OK;
+    } else {
+      symbol -= 257;
+      if (symbol >= 29) {
+        return PNG_ERR_FORMAT;
+      }
+      int len = length_base[symbol] + get_bits(png, length_extra[symbol]);
+      symbol = decode_symbol(png, &png->dist);
+      if (symbol < 0 || symbol >= 30) {
+        return PNG_ERR_FORMAT;
+      }
+      uint32_t dist = dist_base[symbol] + get_bits(png, dist_extra[symbol]);
+      if (dist > png->window_mask + 1) {
+        return PNG_ERR_FORMAT;
+      }
+      uint32_t from = png->window_pos - dist;
+      while (len-- > 0) {
+        int result = put_byte(png, png->window[from++ & png->window_mask]);
+        if (result != PNG_OK || rows_done(png)) {
+          return result;
+        }
+      }
+    }
+  }
+}
+
+static int build_fixed(png_t *png) {
+  uint8_t lengths[288];
+  memset(lengths, 8, 144);
+  memset(lengths + 144, 9, 112);
+  memset(lengths + 256, 7, 24);
+  memset(lengths + 280, 8, 8);
+  build_huffman(&png->lit, lengths, 288);
+  memset(lengths, 5, 30);
+  return build_huffman(&png->dist, lengths, 30);
+}
+
+static int build_dynamic(png_t *png) {
+  int nlit = get_bits(png, 5) + 257;
+  int ndist = get_bits(png, 5) + 1;
+  int ncode = get_bits(png, 4) + 4;
+  if (nlit > 286 || ndist > 30) {
+    return PNG_ERR_FORMAT;
+  }
+
+  // the code length code goes in the literal table until it is needed
+  uint8_t lengths[286 + 30];
+  memset(lengths, 0, sizeof(code_order));
+  for (int i = 0; i < ncode; i++) {
+    lengths[code_order[i]] = get_bits(png, 3);
+  }
+  if (build_huffman(&png->lit, lengths, sizeof(code_order)) != PNG_OK) {
+    return PNG_ERR_FORMAT;
+  }
+
+  for (int i = 0; i < nlit + ndist;) {
+    if (png->padding > MAX_PADDING) {
+      return PNG_ERR_READ;
+    }
+    int symbol = decode_symbol(png, &png->lit);
+    if (symbol < 0) {
+      return PNG_ERR_FORMAT;
+    }
+    if (symbol < 16) {
+      lengths[i++] = symbol;
+      continue;
+    }
+    int len = 0, repeat;
+    if (symbol == 16) {
+      if (i == 0) {
+        return PNG_ERR_FORMAT;
+      }
+      len = lengths[i - 1];
+      repeat = 3 + get_bits(png, 2);
+    } else if (symbol == 17) {
+      repeat = 3 + get_bits(png, 3);
+    } else {
+      repeat = 11 + get_bits(png, 7);
+    }
+    if (i + repeat > nlit + ndist) {
+      return PNG_ERR_FORMAT;
+    }
+    while (repeat--) {
+      lengths[i++] = len;
+    }
+  }
+
+  if (lengths[256] == 0 ||
+      build_huffman(&png->lit, lengths, nlit) != PNG_OK ||
+      build_huffman(&png->dist, lengths + nlit, ndist) != PNG_OK) {
+    return PNG_ERR_FORMAT;
+  }
+  return PNG_OK;
+}
+
+int png_decode(png_t *png, uint8_t *work, png_write_t write, void *ctx) {
+  png->write = write;
+  png->write_ctx = ctx;
+
+  png->pixels = (uint16_t *)work;
+  png->window = work + png->width * sizeof(uint16_t);
+  png->row = png->window + png->window_mask + 1;
+  png->prev = png->row + png->row_bytes + 1;
+  png->alpha = png->prev + png->row_bytes + 1;
+  memset(png->window, 0, png->window_mask + 1);
+  memset(png->prev, 0, png->row_bytes + 1);
+  png->window_pos = 0;
+  png->row_pos = 0;
+  png->y = 0;
+  png->bits = 0;
+  png->nbits = 0;
+
+  bool last;
+  do {
+    last = get_bits(png, 1);
+    int result;
+    switch (get_bits(png, 2)) {
+    case 0:
+      result = inflate_stored(png);
+      break;
+    case 1:
+      result = build_fixed(png);
+      if (result == PNG_OK) {
+        result = inflate_codes(png);
+      }
+      break;
+    case 2:
+      result = build_dynamic(png);
+      if (result == PNG_OK) {
+        result = inflate_codes(png);
+      }
+      break;
+    default:
+      result = PNG_ERR_FORMAT;
+      break;
+    }
+    if (result != PNG_OK) {
+      // errors in the zeros fed past the end mean the data was cut short
+      return png->padding ? PNG_ERR_READ : result;
+    }
+    if (rows_done(png)) {
+      return PNG_OK;
+    }
+  } while (!last);
+
+  return png->padding ? PNG_ERR_READ : PNG_ERR_FORMAT;
+}
@@ -0,0 +1,92 @@
+#ifndef __PNG_H__
+#define __PNG_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming PNG decoder. Input is pulled through a read callback, inflated
+// into a sliding window and unfiltered one scanline at a time, so memory use
+// is the deflate window plus a few rows whatever the height of the image.
+
+#define PNG_INPUT_SIZE 512 // bytes read from the source at a time
+
+// decoder results
+#define PNG_OK 0
+#define PNG_ERR_READ 1        // source ended early
+#define PNG_ERR_FORMAT 2      // not a PNG or corrupt data
+#define PNG_ERR_UNSUPPORTED 3 // interlaced or oversized images
+
+// returns the number of bytes read into buf, 0 at the end of the source
+typedef size_t (*png_read_t)(void *ctx, uint8_t *buf, size_t len);
+
+// receives row y of the image as width RGB565 pixels and their alpha, alpha
+// is NULL when the image has no transparency
+typedef void (*png_write_t)(void *ctx, int y, const uint16_t *pixels,
+                            const uint8_t *alpha, int width);
+
+typedef struct _png_huffman_t {
+  uint16_t lookup[256]; // 8 bit prefix, LSB first, to (length << 9) | symbol,
+                        // 0 if longer
+  uint16_t counts[16];  // number of codes of each length
+  uint16_t symbols[288]; // symbols in canonical code order
+} png_huffman_t;
+
+typedef struct _png_t {
+  png_read_t read;
+  png_write_t write;
+  void *ctx;       // passed to read
+  void *write_ctx; // passed to write
+
+  uint8_t input[PNG_INPUT_SIZE];
+  size_t input_pos;
+  size_t input_len;
+  uint32_t chunk_left; // image data bytes left in the current IDAT chunk
+  uint8_t padding;     // zero bytes fed to the inflater past the end
+
+  uint32_t bits; // compressed bits, LSB first
+  int nbits;
+
+  uint16_t width, height;
+  uint8_t depth;      // bits per sample
+  uint8_t color_type; // 0 gray, 2 RGB, 3 palette, 4 gray alpha, 6 RGBA
+  uint8_t channels;   // samples per pixel
+  uint8_t bpp;        // bytes per pixel for the filters, at least 1
+  bool has_alpha;     // alpha channel or tRNS chunk
+  bool has_key;       // tRNS color key for gray and RGB images
+  uint16_t key[3];    // key color in sample units
+  uint16_t palette[256];
+  uint8_t palette_alpha[256];
+
+  png_huffman_t lit;  // literal and length codes
+  png_huffman_t dist; // distance codes
+
+  size_t work_size; // bytes of work memory png_decode() needs
+  uint8_t *window;  // last window_mask + 1 bytes of inflated data
+  uint32_t window_mask;
+  uint32_t window_pos;
+  size_t row_bytes; // bytes per scanline, without the filter type
+  uint8_t *row;     // scanline being inflated, filter type first
+  uint8_t *prev;    // previous unfiltered scanline, same layout
+  size_t row_pos;   // bytes of the scanline inflated
+  uint16_t y;       // scanline being inflated
+  uint16_t *pixels; // RGB565 output row
+  uint8_t *alpha;   // alpha output row, when has_alpha
+} png_t;
+
+// read the headers up to the start of the image data, sets width, height,
+// has_alpha and work_size
+int png_open(png_t *png, png_read_t read, void *ctx);
+
+// decode the image using work_size bytes of work memory
+int png_decode(png_t *png, uint8_t *work, png_write_t write, void *ctx);
+
+#ifdef __cplusplus
+}
+#endif /*  __cplusplus */
+
+#endif /*  __PNG_H__ */
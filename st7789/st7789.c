@@ -1,9 +1,13 @@
 #define __ST7789_VERSION__ "0.2.0"
 
+#include <math.h>
+#include <string.h>
+
 #include "py/builtin.h"
 #include "py/mphal.h"
 #include "py/obj.h"
 #include "py/runtime.h"
+#include "py/stream.h"
 
 // Fix for MicroPython > 1.21 https://github.com/ricksorensen
 #if MICROPY_VERSION_MAJOR >= 1 && MICROPY_VERSION_MINOR > 21
@@ -12,6 +16,8 @@
 #include "extmod/machine_spi.h"
 #endif
 
+#include "jpg.h"
+#include "png.h"
 #include "st7789.h"
 
 #define _swap_int16_t(a, b)                                                    \
@@ -23,6 +29,7 @@
 #define _swap_bytes(val) ((((val) >> 8) & 0x00FF) | (((val) << 8) & 0xFF00))
 
 #define ABS(N) (((N) < 0) ? (-(N)) : (N))
+#define ASYNC_STEP_SIZE 1024 // bytes sent per scheduler callback
 #define mp_hal_delay_ms(delay) (mp_hal_delay_us(delay * 1000))
 
 // GPIO_NUM_NC is not defined in all ports, you may have to change this to
@@ -124,26 +131,293 @@ static void st7789_ST7789_print(const mp_print_t *print, mp_obj_t self_in,
             self->height, self->spi_obj);
 }
 
-static void write_spi(mp_obj_base_t *spi_obj, const uint8_t *buf, int len) {
+#if ST7789_STATS
+#define STATS_ADD(field, n) (self->stats.field += (n))
+#else
+#define STATS_ADD(field, n)
+#endif
+
+static void write_spi(st7789_ST7789_obj_t *self, const uint8_t *buf,
+                      int len) {
+  mp_obj_base_t *spi_obj = self->spi_obj;
 #ifdef MP_OBJ_TYPE_GET_SLOT
   mp_machine_spi_p_t *spi_p =
       (mp_machine_spi_p_t *)MP_OBJ_TYPE_GET_SLOT(spi_obj->type, protocol);
 #else
   mp_machine_spi_p_t *spi_p = (mp_machine_spi_p_t *)spi_obj->type->protocol;
 #endif
+#if ST7789_STATS
+  mp_uint_t start = mp_hal_ticks_us();
   spi_p->transfer(spi_obj, len, buf, NULL);
+  self->stats.transfer_us += mp_hal_ticks_us() - start;
+  self->stats.spi_writes++;
+  self->stats.bytes += len;
+#else
+  spi_p->transfer(spi_obj, len, buf, NULL);
+#endif
+}
+
+//
+// Pixel formats
+//
+// Drawing works in RGB565. With COLOR_MODE_12BIT the display takes RGB444
+// with two pixels packed in three bytes, so pixel data is packed on the way
+// out through the scratch buffer.
+//
+
+static inline bool is_12bit(st7789_ST7789_obj_t *self) {
+  return self->color_mode == COLOR_MODE_12BIT;
+}
+
+// bytes sent for n pixels, a trailing odd 12 bit pixel is padded to a byte
+static inline size_t pixel_bytes(st7789_ST7789_obj_t *self, size_t n) {
+  return is_12bit(self) ? (n * 3 + 1) / 2 : n * 2;
+}
+
+// pixels the scratch buffer holds, kept even so 12 bit pairs never split
+static inline size_t buffer_pixels(st7789_ST7789_obj_t *self) {
+  return (self->buffer_size / 4) * 2;
+}
+
+// pack big endian RGB565 pixels as RGB444, dst may be the same as src
+static size_t pack_rgb444(uint8_t *dst, const uint8_t *src, size_t n) {
+  uint8_t *out = dst;
+  for (size_t i = 0; i < n; i += 2, src += 4) {
+    uint16_t a = (src[0] << 8) | src[1];
+    *out++ = ((a >> 8) & 0xF0) | ((a >> 7) & 0x0F);
+    if (i + 1 < n) {
+      uint16_t b = (src[2] << 8) | src[3];
+      *out++ = ((a << 3) & 0xF0) | (b >> 12);
+      *out++ = ((b >> 3) & 0xF0) | ((b >> 1) & 0x0F);
+    } else {
+      *out++ = (a << 3) & 0xF0;
+    }
+  }
+  return out - dst;
+}
+
+// send pixel data for the window last set by set_address(), with DC high and
+// CS low. When the window is split by the scroll area the next run of rows
+// is addressed as soon as the current one is full.
+static void write_data(st7789_ST7789_obj_t *self, const uint8_t *data,
+                       size_t len) {
+  st7789_window_t *window = &self->window;
+  while (window->segment + 1 < window->segments &&
+         len >= window->segment_left) {
+    size_t n = window->segment_left;
+    write_spi(self, data, n);
+    data += n;
+    len -= n;
+
+    int i = ++window->segment;
+    uint16_t row0 = window->segment_row[i] + self->rowstart;
+    uint16_t row1 = row0 + window->segment_rows[i] - 1;
+    uint8_t raset = ST7789_RASET, ramwr = ST7789_RAMWR;
+    uint8_t rows[4] = {row0 >> 8, row0 & 0xFF, row1 >> 8, row1 & 0xFF};
+    STATS_ADD(commands, 2);
+    DC_LOW();
+    write_spi(self, &raset, 1);
+    DC_HIGH();
+    write_spi(self, rows, 4);
+    DC_LOW();
+    write_spi(self, &ramwr, 1);
+    DC_HIGH();
+    window->raset[0] = row0;
+    window->raset[1] = row1;
+    window->segment_left =
+        pixel_bytes(self, window->segment_width * window->segment_rows[i]);
+  }
+  if (window->segment + 1 < window->segments) {
+    window->segment_left -= len;
+  }
+  write_spi(self, data, len);
+}
+
+// send n big endian RGB565 pixels from the start of the scratch buffer
+static void write_buffer(st7789_ST7789_obj_t *self, size_t n) {
+  size_t len = n * 2;
+  STATS_ADD(pixels_blitted, n);
+  if (is_12bit(self)) {
+    len = pack_rgb444((uint8_t *)self->buffer, (const uint8_t *)self->buffer,
+                      n);
+  }
+  DC_HIGH();
+  CS_LOW();
+  write_data(self, (const uint8_t *)self->buffer, len);
+  CS_HIGH();
+}
+
+// send rows of big endian RGB565 pixels through the scratch buffer as RGB444
+static void write_rows_12bit(st7789_ST7789_obj_t *self, const uint8_t *data,
+                             size_t row_pixels, size_t stride, size_t rows) {
+  size_t capacity = buffer_pixels(self);
+  size_t len = 0;
+  for (size_t row = 0; row < rows; row++, data += stride) {
+    for (size_t done = 0; done < row_pixels;) {
+      size_t n = MIN(row_pixels - done, capacity - len);
+      memcpy(&self->buffer[len], data + done * 2, n * 2);
+      len += n;
+      done += n;
+      if (len == capacity) {
+        write_buffer(self, len);
+        len = 0;
+      }
+    }
+  }
+  if (len) {
+    write_buffer(self, len);
+  }
+}
+
+// Fill the scratch buffer with up to length pixels of color and return the
+// bytes used. Fills repeat the buffer, so every write but the last must be
+// a whole number of pixels for the pattern to stay in phase.
+static size_t fill_pattern(st7789_ST7789_obj_t *self, uint16_t color,
+                           size_t length) {
+  size_t pixels = MIN(length, buffer_pixels(self));
+  uint16_t color_swapped = _swap_bytes(color);
+  for (size_t i = 0; i < pixels; i++) {
+    self->buffer[i] = color_swapped;
+  }
+  if (is_12bit(self)) {
+    return pack_rgb444((uint8_t *)self->buffer, (const uint8_t *)self->buffer,
+                       pixels);
+  }
+  return pixels * 2;
+}
+
+//
+// Asynchronous transfers
+//
+// machine.SPI only offers a blocking transfer, so with the ASYNC option the
+// data phase of a fill, blit or show is queued as a job and sent in
+// ASYNC_STEP_SIZE steps from scheduler callbacks, letting Python code run
+// between steps. Anything that sends a command first finishes the job, which
+// keeps the display output in call order.
+//
+
+static void async_step(st7789_ST7789_obj_t *self) {
+  st7789_job_t *job = &self->job;
+  size_t budget = ASYNC_STEP_SIZE;
+
+  DC_HIGH();
+  CS_LOW();
+  while (budget && job->rows) {
+    size_t len = MIN(job->row_len - job->offset, budget);
+    if (job->data) {
+      write_data(self, job->data + job->offset, len);
+    } else {
+      len = MIN(len, job->pattern);
+      if (len < job->row_len - job->offset) {
+        // whole 16 and 12 bit pixel pairs keep the pattern in phase
+        len -= len % 6;
+        if (len == 0) {
+          break;
+        }
+      }
+      write_data(self, (const uint8_t *)self->buffer, len);
+    }
+    job->offset += len;
+    budget -= len;
+    if (job->offset == job->row_len) {
+      job->offset = 0;
+      job->rows--;
+      if (job->data) {
+        job->data += job->stride;
+      }
+    }
+  }
+  CS_HIGH();
+
+  if (job->rows == 0) {
+    job->data_obj = MP_OBJ_NULL;
+  }
+}
+
+static void async_wait(st7789_ST7789_obj_t *self) {
+  while (self->job.rows) {
+    async_step(self);
+  }
+}
+
+// finish an ASYNC show() before writing to the frame buffer it reads from
+static inline void frame_buffer_wait(st7789_ST7789_obj_t *self) {
+  if (self->job.rows) {
+    async_wait(self);
+  }
+}
+
+static mp_obj_t st7789_ST7789_async_step(mp_obj_t self_in);
+static MP_DEFINE_CONST_FUN_OBJ_1(st7789_ST7789_async_step_obj,
+                                 st7789_ST7789_async_step);
+
+static void async_schedule(st7789_ST7789_obj_t *self) {
+#if MICROPY_ENABLE_SCHEDULER
+  if (self->job.rows && !self->job.scheduled) {
+    self->job.scheduled =
+        mp_sched_schedule(MP_OBJ_FROM_PTR(&st7789_ST7789_async_step_obj),
+                          MP_OBJ_FROM_PTR(self));
+  }
+#else
+  async_wait(self);
+#endif
+}
+
+static mp_obj_t st7789_ST7789_async_step(mp_obj_t self_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+  self->job.scheduled = false;
+  if (self->job.rows) {
+    async_step(self);
+    async_schedule(self);
+  }
+  return mp_const_none;
+}
+
+// queue rows of data for the window that has just been set
+static void async_start(st7789_ST7789_obj_t *self, mp_obj_t data_obj,
+                        const uint8_t *data, size_t row_len, size_t stride,
+                        size_t rows) {
+  st7789_job_t *job = &self->job;
+  job->data_obj = data_obj;
+  job->data = data;
+  job->row_len = row_len;
+  job->stride = stride;
+  job->offset = 0;
+  job->rows = (row_len > 0) ? rows : 0;
+  async_schedule(self);
+}
+
+static void async_fill(st7789_ST7789_obj_t *self, uint16_t color,
+                       size_t length) {
+  STATS_ADD(pixels_filled, length);
+  self->job.pattern = fill_pattern(self, color, length);
+  async_start(self, MP_OBJ_NULL, NULL, pixel_bytes(self, length), 0, 1);
 }
 
 static void write_cmd(st7789_ST7789_obj_t *self, uint8_t cmd,
                       const uint8_t *data, int len) {
+  async_wait(self);
+
+  // any command ends a RAM write, and a reset or a CASET/RASET sent from
+  // outside set_address() leaves the cached window unknown
+  self->window.open = false;
+  if (cmd == ST7789_CASET || cmd == ST7789_SWRESET) {
+    self->window.caset_valid = false;
+  }
+  if (cmd == ST7789_RASET || cmd == ST7789_SWRESET) {
+    self->window.raset_valid = false;
+  }
+
   CS_LOW()
   if (cmd) {
+    STATS_ADD(commands, 1);
     DC_LOW();
-    write_spi(self->spi_obj, &cmd, 1);
+    write_spi(self, &cmd, 1);
   }
   if (len > 0) {
     DC_HIGH();
-    write_spi(self->spi_obj, data, len);
+    write_spi(self, data, len);
   }
   CS_HIGH()
 }
@@ -165,37 +439,177 @@ static mp_obj_t st7789_ST7789_write(mp_obj_t self_in, mp_obj_t command,
 }
 static MP_DEFINE_CONST_FUN_OBJ_3(st7789_ST7789_write_obj, st7789_ST7789_write);
 
-static void set_window(st7789_ST7789_obj_t *self, uint16_t x0, uint16_t y0,
+static void mark_dirty(st7789_ST7789_obj_t *self, uint16_t x0, uint16_t y0,
                        uint16_t x1, uint16_t y1) {
-  if (x0 > x1 || x1 >= self->width) {
-    return;
+  if (x0 < self->min_x) {
+    self->min_x = x0;
   }
-  if (y0 > y1 || y1 >= self->height) {
-    return;
+  if (x1 > self->max_x) {
+    self->max_x = x1;
+  }
+  if (y0 < self->min_y) {
+    self->min_y = y0;
+  }
+  if (y1 > self->max_y) {
+    self->max_y = y1;
   }
 
-  if (self->bounding) {
-    if (x0 < self->min_x) {
-      self->min_x = x0;
+  int col0 = x0 >> DIRTY_TILE_SHIFT;
+  int col1 = x1 >> DIRTY_TILE_SHIFT;
+  uint32_t mask = (col1 - col0 == 31) ? 0xFFFFFFFF
+                                      : (((1u << (col1 - col0 + 1)) - 1) << col0);
+  for (int row = y0 >> DIRTY_TILE_SHIFT; row <= y1 >> DIRTY_TILE_SHIFT; row++) {
+    self->dirty[row] |= mask;
+  }
+}
+
+static void clear_dirty(st7789_ST7789_obj_t *self) {
+  self->min_x = self->width;
+  self->min_y = self->height;
+  self->max_x = 0;
+  self->max_y = 0;
+  memset(self->dirty, 0, self->dirty_alloc * sizeof(uint32_t));
+}
+
+// Remove the next rectangle of dirty tiles from the map and return it in
+// pixels. Runs of tiles in a row are extended down while the rows below are
+// dirty over the same columns. Returns false when the map is empty.
+static bool next_dirty_rect(st7789_ST7789_obj_t *self, uint32_t *map,
+                            uint16_t *x0, uint16_t *y0, uint16_t *x1,
+                            uint16_t *y1) {
+  for (int row = 0; row < self->dirty_rows; row++) {
+    uint32_t bits = map[row];
+    if (bits == 0) {
+      continue;
+    }
+
+    int first = 0;
+    while (!(bits & (1u << first))) {
+      first++;
+    }
+    int last = first;
+    while (last < 31 && (bits & (1u << (last + 1)))) {
+      last++;
     }
-    if (x1 > self->max_x) {
-      self->max_x = x1;
+    uint32_t mask = (last - first == 31) ? 0xFFFFFFFF
+                                         : (((1u << (last - first + 1)) - 1)
+                                            << first);
+
+    int bottom = row;
+    while (bottom + 1 < self->dirty_rows && (map[bottom + 1] & mask) == mask) {
+      bottom++;
+    }
+    for (int i = row; i <= bottom; i++) {
+      map[i] &= ~mask;
     }
-    if (y0 < self->min_y) {
-      self->min_y = y0;
+
+    *x0 = first << DIRTY_TILE_SHIFT;
+    *y0 = row << DIRTY_TILE_SHIFT;
+    *x1 = MIN(((last + 1) << DIRTY_TILE_SHIFT) - 1, self->width - 1);
+    *y1 = MIN(((bottom + 1) << DIRTY_TILE_SHIFT) - 1, self->height - 1);
+    return true;
+  }
+  return false;
+}
+
+// display row, without rowstart, that logical row y is stored in
+static int scroll_row(st7789_ST7789_obj_t *self, int y) {
+  st7789_scroll_t *scroll = &self->scroll;
+  if (!scroll->active || y < scroll->top ||
+      y >= self->height - scroll->bottom) {
+    return y;
+  }
+  return scroll->top + (y - scroll->top + scroll->offset) % scroll->rows;
+}
+
+// split logical rows y0..y1 into runs of consecutive display rows
+static void scroll_segments(st7789_ST7789_obj_t *self, int y0, int y1) {
+  st7789_window_t *window = &self->window;
+  st7789_scroll_t *scroll = &self->scroll;
+
+  // rows where the display row can jump: the start of the scroll area, the
+  // wrap inside it and the start of the bottom area
+  int cuts[4] = {scroll->top, scroll->top + scroll->rows - scroll->offset,
+                 self->height - scroll->bottom, y1 + 1};
+  window->segments = 0;
+  for (int i = 0, start = y0; i < 4; i++) {
+    int end = MIN(cuts[i], y1 + 1);
+    if (end <= start) {
+      continue;
     }
-    if (y1 > self->max_y) {
-      self->max_y = y1;
+    int row = scroll_row(self, start);
+    int n = window->segments;
+    if (n && window->segment_row[n - 1] + window->segment_rows[n - 1] == row) {
+      window->segment_rows[n - 1] += end - start;
+    } else {
+      window->segment_row[n] = row;
+      window->segment_rows[n] = end - start;
+      window->segments++;
     }
+    start = end;
   }
+}
 
-  uint8_t bufx[4] = {(x0 + self->colstart) >> 8, (x0 + self->colstart) & 0xFF,
-                     (x1 + self->colstart) >> 8, (x1 + self->colstart) & 0xFF};
-  uint8_t bufy[4] = {(y0 + self->rowstart) >> 8, (y0 + self->rowstart) & 0xFF,
-                     (y1 + self->rowstart) >> 8, (y1 + self->rowstart) & 0xFF};
-  write_cmd(self, ST7789_CASET, bufx, 4);
-  write_cmd(self, ST7789_RASET, bufy, 4);
+// Start a RAM write to the window, only sending the CASET and RASET
+// commands whose parameters differ from what the display already holds.
+// The window is in display addresses, including colstart and rowstart.
+static void send_address(st7789_ST7789_obj_t *self, uint16_t col0,
+                         uint16_t row0, uint16_t col1, uint16_t row1) {
+  st7789_window_t *window = &self->window;
+  if (!window->caset_valid || window->caset[0] != col0 ||
+      window->caset[1] != col1) {
+    uint8_t bufx[4] = {col0 >> 8, col0 & 0xFF, col1 >> 8, col1 & 0xFF};
+    write_cmd(self, ST7789_CASET, bufx, 4);
+    window->caset[0] = col0;
+    window->caset[1] = col1;
+    window->caset_valid = true;
+  }
+  if (!window->raset_valid || window->raset[0] != row0 ||
+      window->raset[1] != row1) {
+    uint8_t bufy[4] = {row0 >> 8, row0 & 0xFF, row1 >> 8, row1 & 0xFF};
+    write_cmd(self, ST7789_RASET, bufy, 4);
+    window->raset[0] = row0;
+    window->raset[1] = row1;
+    window->raset_valid = true;
+  }
   write_cmd(self, ST7789_RAMWR, NULL, 0);
+  STATS_ADD(windows, 1);
+}
+
+static void set_address(st7789_ST7789_obj_t *self, uint16_t x0, uint16_t y0,
+                        uint16_t x1, uint16_t y1) {
+  st7789_window_t *window = &self->window;
+  window->segments = 1;
+  window->segment = 0;
+  if (self->scroll.active) {
+    scroll_segments(self, y0, y1);
+    window->segment_width = x1 - x0 + 1;
+    window->segment_left =
+        pixel_bytes(self, window->segment_width * window->segment_rows[0]);
+    y0 = window->segment_row[0];
+    y1 = y0 + window->segment_rows[0] - 1;
+  }
+
+  send_address(self, x0 + self->colstart, y0 + self->rowstart,
+               x1 + self->colstart, y1 + self->rowstart);
+}
+
+static void set_window(st7789_ST7789_obj_t *self, uint16_t x0, uint16_t y0,
+                       uint16_t x1, uint16_t y1) {
+  if (x0 > x1 || x1 >= self->width) {
+    return;
+  }
+  if (y0 > y1 || y1 >= self->height) {
+    return;
+  }
+
+  // in framebuffer mode the bounds track drawing into the buffer, not the
+  // windows used to flush it
+  if (self->bounding && self->frame_buffer == NULL) {
+    mark_dirty(self, x0, y0, x1, y1);
+  }
+
+  set_address(self, x0, y0, x1, y1);
 }
 
 static mp_obj_t st7789_ST7789_set_window(size_t n_args, const mp_obj_t *args) {
@@ -213,13 +627,22 @@ static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_set_window_obj, 5, 5,
 static mp_obj_t st7789_ST7789_hard_reset(mp_obj_t self_in) {
   st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
+  async_wait(self);
+  self->window.open = false;
+  self->window.caset_valid = false;
+  self->window.raset_valid = false;
+
+  if (self->reset == GPIO_NUM_NC) {
+    return mp_const_none;
+  }
+
   CS_LOW();
   RESET_HIGH();
-  mp_hal_delay_ms(50);
+  mp_hal_delay_ms(self->reset_delays[0]);
   RESET_LOW();
-  mp_hal_delay_ms(50);
+  mp_hal_delay_ms(self->reset_delays[1]);
   RESET_HIGH();
-  mp_hal_delay_ms(150);
+  mp_hal_delay_ms(self->reset_delays[2]);
   CS_HIGH();
   return mp_const_none;
 }
@@ -262,26 +685,162 @@ static mp_obj_t st7789_ST7789_inversion_mode(mp_obj_t self_in, mp_obj_t value) {
 static MP_DEFINE_CONST_FUN_OBJ_2(st7789_ST7789_inversion_mode_obj,
                                  st7789_ST7789_inversion_mode);
 
-static void fill_color_buffer(mp_obj_base_t *spi_obj, uint16_t color,
-                              int length) {
-  const int buffer_pixel_size = 128;
-  int chunks = length / buffer_pixel_size;
-  int rest = length % buffer_pixel_size;
-  uint16_t color_swapped = _swap_bytes(color);
-  uint16_t buffer[buffer_pixel_size]; // 128 pixels
+static void fill_color_buffer(st7789_ST7789_obj_t *self, uint16_t color,
+                              size_t length) {
+  STATS_ADD(pixels_filled, length);
+  size_t total = pixel_bytes(self, length);
+  size_t chunk = fill_pattern(self, color, length);
+
+  for (; total > chunk; total -= chunk) {
+    write_data(self, (uint8_t *)self->buffer, chunk);
+  }
+  if (total) {
+    write_data(self, (uint8_t *)self->buffer, total);
+  }
+}
+
+// fill an on-screen window, x0..x1 and y0..y1 must already be clipped
+static void fill_window(st7789_ST7789_obj_t *self, uint16_t x0, uint16_t y0,
+                        uint16_t x1, uint16_t y1, uint16_t color) {
+  if (self->frame_buffer) {
+    frame_buffer_wait(self);
+    uint16_t color_swapped = _swap_bytes(color);
+    for (int y = y0; y <= y1; y++) {
+      uint16_t *p = &self->frame_buffer[y * self->width + x0];
+      for (int x = x0; x <= x1; x++) {
+        *p++ = color_swapped;
+      }
+    }
+    mark_dirty(self, x0, y0, x1, y1);
+  } else {
+    set_window(self, x0, y0, x1, y1);
+    if (self->options & OPTIONS_ASYNC) {
+      async_fill(self, color, (x1 - x0 + 1) * (y1 - y0 + 1));
+      return;
+    }
+    DC_HIGH();
+    CS_LOW();
+    fill_color_buffer(self, color, (x1 - x0 + 1) * (y1 - y0 + 1));
+    CS_HIGH();
+  }
+}
+
+//
+// Pixel streams
+//
+// Text and decoded images produce pixels in row order for a window that can
+// hang off any edge of the display. stream_begin() sets the visible part of
+// the window once, stream_pixel() drops off screen pixels and batches the
+// rest through the scratch buffer, and stream_end() sends what is left.
+//
+
+static void stream_flush(st7789_ST7789_obj_t *self, st7789_stream_t *stream) {
+  if (stream->len) {
+    write_buffer(self, stream->len);
+    stream->len = 0;
+  }
+}
 
-  // fill buffer with color data
+static void stream_begin(st7789_ST7789_obj_t *self, st7789_stream_t *stream,
+                         int x, int y, int w, int h) {
+  stream->x0 = x;
+  stream->y0 = y;
+  stream->x1 = x + w - 1;
+  stream->y1 = y + h - 1;
+  stream->cx0 = MAX(x, 0);
+  stream->cy0 = MAX(y, 0);
+  stream->cx1 = MIN(stream->x1, self->width - 1);
+  stream->cy1 = MIN(stream->y1, self->height - 1);
+  stream->x = x;
+  stream->y = y;
+  stream->len = 0;
+  stream->visible =
+      w > 0 && h > 0 && stream->cx0 <= stream->cx1 && stream->cy0 <= stream->cy1;
+
+  if (stream->visible && self->frame_buffer == NULL) {
+    set_window(self, stream->cx0, stream->cy0, stream->cx1, stream->cy1);
+  }
+}
+
+static inline void stream_pixel(st7789_ST7789_obj_t *self,
+                                st7789_stream_t *stream, uint16_t color) {
+  int x = stream->x, y = stream->y;
+
+  if (++stream->x > stream->x1) {
+    stream->x = stream->x0;
+    stream->y++;
+  }
+  if (x < stream->cx0 || x > stream->cx1 || y < stream->cy0 ||
+      y > stream->cy1) {
+    return;
+  }
 
-  for (int i = 0; i < length && i < buffer_pixel_size; i++) {
-    buffer[i] = color_swapped;
+  if (self->frame_buffer) {
+    frame_buffer_wait(self);
+    self->frame_buffer[y * self->width + x] = _swap_bytes(color);
+    return;
   }
-  if (chunks) {
-    for (int j = 0; j < chunks; j++) {
-      write_spi(spi_obj, (uint8_t *)buffer, buffer_pixel_size * 2);
+  self->buffer[stream->len++] = _swap_bytes(color);
+  if (stream->len == buffer_pixels(self)) {
+    stream_flush(self, stream);
+  }
+}
+
+// runs at least this long are sent as a fill
+#define STREAM_RUN_MIN 16
+
+// count pixels of one color, long runs in a window that is entirely on
+// screen are sent straight from a fill pattern
+static void stream_run(st7789_ST7789_obj_t *self, st7789_stream_t *stream,
+                       uint16_t color, size_t count) {
+  bool unclipped = stream->cx0 == stream->x0 && stream->cy0 == stream->y0 &&
+                   stream->cx1 == stream->x1 && stream->cy1 == stream->y1;
+
+  if (unclipped && count >= STREAM_RUN_MIN && self->frame_buffer == NULL &&
+      stream->y <= stream->y1) {
+    // 12 bit pixel pairs must not straddle the fill
+    if (is_12bit(self) && (stream->len & 1)) {
+      stream_pixel(self, stream, color);
+      count--;
+    }
+
+    size_t w = stream->x1 - stream->x0 + 1;
+    size_t left = (stream->y1 - stream->y + 1) * w - (stream->x - stream->x0);
+    size_t fill = MIN(count, left);
+    if (is_12bit(self) && fill < left) {
+      fill &= ~1;
     }
+
+    stream_flush(self, stream);
+    DC_HIGH();
+    CS_LOW();
+    fill_color_buffer(self, color, fill);
+    CS_HIGH();
+
+    size_t pos = (stream->x - stream->x0) + fill;
+    stream->x = stream->x0 + pos % w;
+    stream->y += pos / w;
+    count -= fill;
   }
-  if (rest) {
-    write_spi(spi_obj, (uint8_t *)buffer, rest * 2);
+
+  while (count--) {
+    stream_pixel(self, stream, color);
+  }
+}
+
+// true once the rest of the window is below the display
+static inline bool stream_done(st7789_stream_t *stream) {
+  return !stream->visible || stream->y > stream->cy1;
+}
+
+static void stream_end(st7789_ST7789_obj_t *self, st7789_stream_t *stream) {
+  if (!stream->visible) {
+    return;
+  }
+  if (self->frame_buffer) {
+    mark_dirty(self, stream->cx0, stream->cy0, stream->cx1, stream->cy1);
+  } else {
+    stream_flush(self, stream);
   }
 }
 
@@ -302,13 +861,50 @@ static void draw_pixel(st7789_ST7789_obj_t *self, int16_t x, int16_t y,
   }
 
   if ((x < self->width) && (y < self->height) && (x >= 0) && (y >= 0)) {
-    uint8_t hi = color >> 8, lo = color & 0xff;
-    set_window(self, x, y, x, y);
+    if (self->frame_buffer) {
+      frame_buffer_wait(self);
+      self->frame_buffer[y * self->width + x] = _swap_bytes(color);
+      mark_dirty(self, x, y, x, y);
+      return;
+    }
+    if (self->bounding) {
+      mark_dirty(self, x, y, x, y);
+    }
+
+    st7789_window_t *window = &self->window;
+    if (!window->open || window->x != x || window->y != y) {
+      // open the window to the bottom right corner so that following pixels
+      // to the right stream without commands, and pixels below or to the
+      // right only need one of CASET or RASET
+      set_address(self, x, y, self->width - 1, self->height - 1);
+      window->open = true;
+      window->x0 = x;
+      window->y0 = y;
+      window->x1 = self->width - 1;
+      window->y1 = self->height - 1;
+    }
+
+    uint8_t buf[2] = {color >> 8, color & 0xff};
+    if (is_12bit(self)) {
+      // the padding nibble would start the next pixel, so don't stream
+      pack_rgb444(buf, buf, 1);
+      window->open = false;
+    }
+    STATS_ADD(pixels_blitted, 1);
     DC_HIGH();
     CS_LOW();
-    write_spi(self->spi_obj, &hi, 1);
-    write_spi(self->spi_obj, &lo, 1);
+    write_data(self, buf, 2);
     CS_HIGH();
+
+    window->x = x + 1;
+    window->y = y;
+    if (window->x > window->x1) {
+      window->x = window->x0;
+      if (++window->y > window->y1) {
+        // a split window wraps to its last run of rows, not the first
+        window->open = false;
+      }
+    }
   }
 }
 
@@ -339,12 +935,7 @@ static void fast_hline(st7789_ST7789_obj_t *self, int16_t x, int16_t y,
       }
 
       if (w > 0) {
-        int16_t x2 = x + w - 1;
-        set_window(self, x, y, x2, y);
-        DC_HIGH();
-        CS_LOW();
-        fill_color_buffer(self->spi_obj, color, w);
-        CS_HIGH();
+        fill_window(self, x, y, x + w - 1, y, color);
       }
     }
   } else {
@@ -376,216 +967,2856 @@ static void fast_vline(st7789_ST7789_obj_t *self, int16_t x, int16_t y,
         y = 0;
       }
 
-      if (self->height < y + h) {
-        h = self->height - y;
-      }
+      if (self->height < y + h) {
+        h = self->height - y;
+      }
+
+      if (h > 0) {
+        fill_window(self, x, y, x, y + h - 1, color);
+      }
+    }
+  } else {
+    for (int d = 0; d < h; d++) {
+      draw_pixel(self, x, y + d, color);
+    }
+  }
+}
+
+static mp_obj_t st7789_ST7789_vline(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t x = mp_obj_get_int(args[1]);
+  mp_int_t y = mp_obj_get_int(args[2]);
+  mp_int_t w = mp_obj_get_int(args[3]);
+  mp_int_t color = mp_obj_get_int(args[4]);
+
+  fast_vline(self, x, y, w, color);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_vline_obj, 5, 5,
+                                           st7789_ST7789_vline);
+
+static void rect(st7789_ST7789_obj_t *self, int16_t x, int16_t y, int16_t w,
+                 int16_t h, uint16_t color) {
+  fast_hline(self, x, y, w, color);
+  fast_vline(self, x, y, h, color);
+  fast_hline(self, x, y + h - 1, w, color);
+  fast_vline(self, x + w - 1, y, h, color);
+}
+
+static mp_obj_t st7789_ST7789_rect(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t x = mp_obj_get_int(args[1]);
+  mp_int_t y = mp_obj_get_int(args[2]);
+  mp_int_t w = mp_obj_get_int(args[3]);
+  mp_int_t h = mp_obj_get_int(args[4]);
+  mp_int_t color = mp_obj_get_int(args[5]);
+
+  rect(self, x, y, w, h, color);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_rect_obj, 6, 6,
+                                           st7789_ST7789_rect);
+
+static void fill_rect(st7789_ST7789_obj_t *self, int x, int y, int w, int h,
+                      uint16_t color) {
+  int right = x + w - 1;
+  int bottom = y + h - 1;
+
+  if (x < 0) {
+    x = 0;
+  }
+  if (y < 0) {
+    y = 0;
+  }
+  if (right >= self->width) {
+    right = self->width - 1;
+  }
+  if (bottom >= self->height) {
+    bottom = self->height - 1;
+  }
+
+  if (x <= right && y <= bottom) {
+    fill_window(self, x, y, right, bottom, color);
+  }
+}
+
+static mp_obj_t st7789_ST7789_fill_rect(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t x = mp_obj_get_int(args[1]);
+  mp_int_t y = mp_obj_get_int(args[2]);
+  mp_int_t w = mp_obj_get_int(args[3]);
+  mp_int_t h = mp_obj_get_int(args[4]);
+  mp_int_t color = mp_obj_get_int(args[5]);
+
+  fill_rect(self, x, y, w, h, color);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_fill_rect_obj, 6, 6,
+                                           st7789_ST7789_fill_rect);
+
+static mp_obj_t st7789_ST7789_fill(mp_obj_t self_in, mp_obj_t _color) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  mp_int_t color = mp_obj_get_int(_color);
+
+  fill_window(self, 0, 0, self->width - 1, self->height - 1, color);
+
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(st7789_ST7789_fill_obj, st7789_ST7789_fill);
+
+static void line(st7789_ST7789_obj_t *self, int16_t x0, int16_t y0, int16_t x1,
+                 int16_t y1, int16_t color) {
+  bool steep = ABS(y1 - y0) > ABS(x1 - x0);
+  if (steep) {
+    _swap_int16_t(x0, y0);
+    _swap_int16_t(x1, y1);
+  }
+
+  if (x0 > x1) {
+    _swap_int16_t(x0, x1);
+    _swap_int16_t(y0, y1);
+  }
+
+  int16_t dx = x1 - x0, dy = ABS(y1 - y0);
+  int16_t err = dx >> 1, ystep = -1, xs = x0, dlen = 0;
+
+  if (y0 < y1) {
+    ystep = 1;
+  }
+
+  // Split into steep and not steep for FastH/V separation
+  if (steep) {
+    for (; x0 <= x1; x0++) {
+      dlen++;
+      err -= dy;
+      if (err < 0) {
+        err += dx;
+        if (dlen == 1) {
+          draw_pixel(self, y0, xs, color);
+        } else {
+          fast_vline(self, y0, xs, dlen, color);
+        }
+        dlen = 0;
+        y0 += ystep;
+        xs = x0 + 1;
+      }
+    }
+    if (dlen) {
+      fast_vline(self, y0, xs, dlen, color);
+    }
+  } else {
+    for (; x0 <= x1; x0++) {
+      dlen++;
+      err -= dy;
+      if (err < 0) {
+        err += dx;
+        if (dlen == 1) {
+          draw_pixel(self, xs, y0, color);
+        } else {
+          fast_hline(self, xs, y0, dlen, color);
+        }
+        dlen = 0;
+        y0 += ystep;
+        xs = x0 + 1;
+      }
+    }
+    if (dlen) {
+      fast_hline(self, xs, y0, dlen, color);
+    }
+  }
+}
+
+static mp_obj_t st7789_ST7789_line(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t x0 = mp_obj_get_int(args[1]);
+  mp_int_t y0 = mp_obj_get_int(args[2]);
+  mp_int_t x1 = mp_obj_get_int(args[3]);
+  mp_int_t y1 = mp_obj_get_int(args[4]);
+  mp_int_t color = mp_obj_get_int(args[5]);
+
+  line(self, x0, y0, x1, y1, color);
+
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_line_obj, 6, 6,
+                                           st7789_ST7789_line);
+
+//
+// Batch drawing
+//
+// Each batch method takes an array('h') of packed records and draws them
+// all in one call. When the optional color argument is given the records
+// leave out their color value.
+//
+
+static const int16_t *get_records(mp_obj_t records_in, size_t stride,
+                                  size_t *count) {
+  mp_buffer_info_t records_info;
+  mp_get_buffer_raise(records_in, &records_info, MP_BUFFER_READ);
+  // other typecodes would be read as the wrong values, or misaligned
+  if (records_info.typecode != 'h') {
+    mp_raise_ValueError(MP_ERROR_TEXT("records must be an array('h')"));
+  }
+  *count = records_info.len / (stride * sizeof(int16_t));
+  return (const int16_t *)records_info.buf;
+}
+
+static mp_obj_t st7789_ST7789_pixels(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  bool one_color = n_args > 2;
+  uint16_t color = one_color ? mp_obj_get_int(args[2]) : 0;
+  size_t stride = one_color ? 2 : 3;
+  size_t count;
+  const int16_t *r = get_records(args[1], stride, &count);
+
+  for (size_t i = 0; i < count; i++, r += stride) {
+    draw_pixel(self, r[0], r[1], one_color ? color : (uint16_t)r[2]);
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_pixels_obj, 2, 3,
+                                           st7789_ST7789_pixels);
+
+static mp_obj_t st7789_ST7789_lines(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  bool one_color = n_args > 2;
+  uint16_t color = one_color ? mp_obj_get_int(args[2]) : 0;
+  size_t stride = one_color ? 4 : 5;
+  size_t count;
+  const int16_t *r = get_records(args[1], stride, &count);
+
+  for (size_t i = 0; i < count; i++, r += stride) {
+    line(self, r[0], r[1], r[2], r[3], one_color ? color : (uint16_t)r[4]);
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_lines_obj, 2, 3,
+                                           st7789_ST7789_lines);
+
+static mp_obj_t st7789_ST7789_rects(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  bool one_color = n_args > 2;
+  uint16_t color = one_color ? mp_obj_get_int(args[2]) : 0;
+  size_t stride = one_color ? 4 : 5;
+  size_t count;
+  const int16_t *r = get_records(args[1], stride, &count);
+
+  for (size_t i = 0; i < count; i++, r += stride) {
+    rect(self, r[0], r[1], r[2], r[3], one_color ? color : (uint16_t)r[4]);
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_rects_obj, 2, 3,
+                                           st7789_ST7789_rects);
+
+static mp_obj_t st7789_ST7789_fill_rects(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  bool one_color = n_args > 2;
+  uint16_t color = one_color ? mp_obj_get_int(args[2]) : 0;
+  size_t stride = one_color ? 4 : 5;
+  size_t count;
+  const int16_t *r = get_records(args[1], stride, &count);
+
+  for (size_t i = 0; i < count; i++, r += stride) {
+    fill_rect(self, r[0], r[1], r[2], r[3],
+              one_color ? color : (uint16_t)r[4]);
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_fill_rects_obj, 2, 3,
+                                           st7789_ST7789_fill_rects);
+
+//
+// Polygons
+//
+// polygon() and fill_polygon() take a list of (x, y) points, an x, y offset
+// and an optional rotation in radians around center_x, center_y.
+//
+
+typedef struct _polygon_edge_t {
+  int16_t y_min;  // first scanline crossed
+  int16_t y_max;  // scanline after the last one crossed
+  int64_t x;      // x at the current scanline, 16.16 fixed point
+  int64_t dx;     // x step per scanline, 16.16 fixed point
+} polygon_edge_t;
+
+// rotate and translate the points, returns x, y pairs allocated with m_new
+static int16_t *polygon_points(size_t n_args, const mp_obj_t *args,
+                               size_t *count) {
+  size_t len;
+  mp_obj_t *points;
+  mp_obj_get_array(args[1], &len, &points);
+  if (len < 2) {
+    mp_raise_ValueError(MP_ERROR_TEXT("polygon needs at least 2 points"));
+  }
+
+  mp_int_t x = mp_obj_get_int(args[2]);
+  mp_int_t y = mp_obj_get_int(args[3]);
+  float angle = (n_args > 5) ? mp_obj_get_float(args[5]) : 0;
+  float center_x = (n_args > 6) ? mp_obj_get_float(args[6]) : 0;
+  float center_y = (n_args > 7) ? mp_obj_get_float(args[7]) : 0;
+  float cos_a = cosf(angle);
+  float sin_a = sinf(angle);
+
+  int16_t *xy = m_new(int16_t, len * 2);
+  for (size_t i = 0; i < len; i++) {
+    mp_obj_t *point;
+    mp_obj_get_array_fixed_n(points[i], 2, &point);
+    float px = mp_obj_get_float(point[0]) - center_x;
+    float py = mp_obj_get_float(point[1]) - center_y;
+    xy[i * 2] = (int16_t)floorf(px * cos_a - py * sin_a + center_x + x + 0.5f);
+    xy[i * 2 + 1] =
+        (int16_t)floorf(px * sin_a + py * cos_a + center_y + y + 0.5f);
+  }
+  *count = len;
+  return xy;
+}
+
+static mp_obj_t st7789_ST7789_polygon(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t color = mp_obj_get_int(args[4]);
+  size_t count;
+  int16_t *xy = polygon_points(n_args, args, &count);
+
+  for (size_t i = 0; i < count; i++) {
+    size_t next = (i + 1) % count;
+    if (next == 0 && xy[0] == xy[i * 2] && xy[1] == xy[i * 2 + 1]) {
+      break; // already closed
+    }
+    line(self, xy[i * 2], xy[i * 2 + 1], xy[next * 2], xy[next * 2 + 1],
+         color);
+  }
+
+  m_del(int16_t, xy, count * 2);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_polygon_obj, 5, 8,
+                                           st7789_ST7789_polygon);
+
+// Scanline fill with an active edge table. Pixels are filled when their
+// center is inside the polygon, so edges shared by adjacent polygons are
+// drawn exactly once.
+static void fill_polygon(st7789_ST7789_obj_t *self, const int16_t *xy,
+                         size_t count, uint16_t color) {
+  polygon_edge_t *edges = m_new(polygon_edge_t, count);
+  size_t edge_count = 0;
+  int y_min = INT16_MAX, y_max = INT16_MIN;
+
+  // edge table sorted by first scanline, horizontal edges are dropped
+  for (size_t i = 0; i < count; i++) {
+    size_t next = (i + 1) % count;
+    int x0 = xy[i * 2], y0 = xy[i * 2 + 1];
+    int x1 = xy[next * 2], y1 = xy[next * 2 + 1];
+    if (y0 == y1) {
+      continue;
+    }
+    if (y0 > y1) {
+      _swap_int16_t(x0, x1);
+      _swap_int16_t(y0, y1);
+    }
+
+    polygon_edge_t edge;
+    edge.y_min = y0;
+    edge.y_max = y1;
+    // 64 bits, int16 points give slopes and positions beyond 32 bits
+    edge.dx = (int64_t)(x1 - x0) * 65536 / (y1 - y0);
+    // x where the edge crosses the center of its first scanline
+    edge.x = (int64_t)x0 * 65536 + edge.dx / 2;
+
+    size_t j = edge_count++;
+    while (j > 0 && edges[j - 1].y_min > edge.y_min) {
+      edges[j] = edges[j - 1];
+      j--;
+    }
+    edges[j] = edge;
+
+    y_min = MIN(y_min, y0);
+    y_max = MAX(y_max, y1);
+  }
+
+  // the active edges are kept at the front of the table, sorted by x,
+  // followed by the edges not reached yet
+  size_t active = 0;
+  // spans wrap with WRAP_V, otherwise rows off the display are skipped
+  bool wrap = (self->options & OPTIONS_WRAP_V) != 0;
+  int y_end = wrap ? y_max : MIN(y_max, self->height);
+
+  for (int y = y_min; y < y_end; y++) {
+    while (active < edge_count && edges[active].y_min == y) {
+      active++;
+    }
+
+    // drop finished edges
+    size_t kept = 0;
+    for (size_t j = 0; j < active; j++) {
+      if (edges[j].y_max > y) {
+        edges[kept++] = edges[j];
+      }
+    }
+    memmove(&edges[kept], &edges[active],
+            (edge_count - active) * sizeof(polygon_edge_t));
+    edge_count -= active - kept;
+    active = kept;
+
+    // insertion sort, the order rarely changes between scanlines
+    for (size_t j = 1; j < active; j++) {
+      polygon_edge_t edge = edges[j];
+      size_t k = j;
+      while (k > 0 && edges[k - 1].x > edge.x) {
+        edges[k] = edges[k - 1];
+        k--;
+      }
+      edges[k] = edge;
+    }
+
+    if (y >= 0 || wrap) {
+      for (size_t j = 0; j + 1 < active; j += 2) {
+        // first and last pixel centers between the two crossings
+        int x0 = (edges[j].x + 0x7FFF) >> 16;
+        int x1 = (edges[j + 1].x + 0x7FFF) >> 16;
+        // keep the width within fast_hline's int16_t
+        if (self->options & OPTIONS_WRAP_H) {
+          // a span as wide as the display already covers every column
+          int w = MIN(x1 - x0, self->width);
+          x0 = mod(x0, self->width);
+          x1 = x0 + w;
+        } else {
+          x0 = MAX(x0, 0);
+          x1 = MIN(x1, self->width);
+        }
+        if (x1 > x0) {
+          fast_hline(self, x0, y, x1 - x0, color);
+        }
+      }
+    }
+
+    for (size_t j = 0; j < active; j++) {
+      edges[j].x += edges[j].dx;
+    }
+  }
+
+  m_del(polygon_edge_t, edges, count);
+}
+
+static mp_obj_t st7789_ST7789_fill_polygon(size_t n_args,
+                                           const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t color = mp_obj_get_int(args[4]);
+  size_t count;
+  int16_t *xy = polygon_points(n_args, args, &count);
+
+  fill_polygon(self, xy, count, color);
+
+  m_del(int16_t, xy, count * 2);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_fill_polygon_obj, 5,
+                                           8, st7789_ST7789_fill_polygon);
+
+// a string, bytes or a single character code
+static const uint8_t *string_arg(mp_obj_t arg, size_t *len, uint8_t *chr) {
+  if (mp_obj_is_int(arg)) {
+    *chr = mp_obj_get_int(arg);
+    *len = 1;
+    return chr;
+  }
+  return (const uint8_t *)mp_obj_str_get_data(arg, len);
+}
+
+//
+// Bitmap text
+//
+
+static void bitmap_font(mp_obj_t font_obj, st7789_bitmap_font_t *font) {
+  font->width = mp_obj_get_int(mp_load_attr(font_obj, MP_QSTR_WIDTH));
+  font->height = mp_obj_get_int(mp_load_attr(font_obj, MP_QSTR_HEIGHT));
+  font->first = mp_obj_get_int(mp_load_attr(font_obj, MP_QSTR_FIRST));
+  font->last = mp_obj_get_int(mp_load_attr(font_obj, MP_QSTR_LAST));
+
+  mp_buffer_info_t bufinfo;
+  mp_get_buffer_raise(mp_load_attr(font_obj, MP_QSTR_FONT), &bufinfo,
+                      MP_BUFFER_READ);
+  font->glyphs = bufinfo.buf;
+  font->row_bytes = (font->width + 7) / 8;
+  font->glyph_size = font->row_bytes * font->height;
+
+  if (font->width == 0 || font->height == 0 || font->last < font->first ||
+      bufinfo.len < (font->last - font->first + 1) * font->glyph_size) {
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid font"));
+  }
+}
+
+static inline bool bitmap_font_has(const st7789_bitmap_font_t *font,
+                                   uint8_t c) {
+  return c >= font->first && c <= font->last;
+}
+
+// draw one line of text through a single window, characters missing from
+// the font are skipped
+static void text_line(st7789_ST7789_obj_t *self,
+                      const st7789_bitmap_font_t *font, const uint8_t *str,
+                      size_t len, int x, int y, uint16_t fg, uint16_t bg) {
+  size_t chars = 0;
+  for (size_t i = 0; i < len; i++) {
+    chars += bitmap_font_has(font, str[i]);
+  }
+
+  st7789_stream_t stream;
+  stream_begin(self, &stream, x, y, chars * font->width, font->height);
+  for (int row = 0; row < font->height && !stream_done(&stream); row++) {
+    for (size_t i = 0; i < len; i++) {
+      if (!bitmap_font_has(font, str[i])) {
+        continue;
+      }
+      const uint8_t *bits = font->glyphs +
+                            (str[i] - font->first) * font->glyph_size +
+                            row * font->row_bytes;
+      for (int col = 0; col < font->width; col++) {
+        stream_pixel(self, &stream,
+                     (bits[col >> 3] & (0x80 >> (col & 7))) ? fg : bg);
+      }
+    }
+  }
+  stream_end(self, &stream);
+}
+
+static mp_obj_t st7789_ST7789_text(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  st7789_bitmap_font_t font;
+  bitmap_font(args[1], &font);
+
+  size_t len;
+  uint8_t chr;
+  const uint8_t *str = string_arg(args[2], &len, &chr);
+
+  mp_int_t x = mp_obj_get_int(args[3]);
+  mp_int_t y = mp_obj_get_int(args[4]);
+  mp_int_t fg = (n_args > 5) ? mp_obj_get_int(args[5]) : WHITE;
+  mp_int_t bg = (n_args > 6) ? mp_obj_get_int(args[6]) : BLACK;
+
+  // one window per line
+  const uint8_t *end = str + len;
+  while (str < end) {
+    const uint8_t *eol = memchr(str, '\n', end - str);
+    if (eol == NULL) {
+      eol = end;
+    }
+    text_line(self, &font, str, eol - str, x, y, fg, bg);
+    str = eol + 1;
+    y += font.height;
+  }
+
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_text_obj, 5, 7,
+                                           st7789_ST7789_text);
+
+//
+// Hershey vector text
+//
+// A vector font module has INDEX, two little endian bytes per character from
+// ' ' to DEL giving the offset of the glyph in FONT. A glyph is a vertex
+// count, the left and right extents and then x, y vertex pairs, all biased by
+// 'R'. A ' ' pair lifts the pen.
+//
+
+#define HERSHEY_BIAS 0x52
+
+typedef struct _hershey_font_t {
+  const uint8_t *index;
+  size_t index_len;
+  const uint8_t *font;
+  size_t font_len;
+} hershey_font_t;
+
+static void hershey_font(mp_obj_t font_obj, hershey_font_t *font) {
+  mp_buffer_info_t bufinfo;
+  mp_get_buffer_raise(mp_load_attr(font_obj, MP_QSTR_INDEX), &bufinfo,
+                      MP_BUFFER_READ);
+  font->index = bufinfo.buf;
+  font->index_len = bufinfo.len;
+  mp_get_buffer_raise(mp_load_attr(font_obj, MP_QSTR_FONT), &bufinfo,
+                      MP_BUFFER_READ);
+  font->font = bufinfo.buf;
+  font->font_len = bufinfo.len;
+}
+
+// returns the glyph for c or NULL, *end is set past the glyph data
+static const uint8_t *hershey_glyph(const hershey_font_t *font, uint8_t c,
+                                    const uint8_t **end) {
+  size_t ii = (c - ' ') * 2;
+  if (c < ' ' || ii + 1 >= font->index_len) {
+    return NULL;
+  }
+  size_t offset = font->index[ii] | (font->index[ii + 1] << 8);
+  if (offset + 3 > font->font_len) {
+    return NULL;
+  }
+  const uint8_t *glyph = &font->font[offset];
+  *end = glyph + 3 + glyph[0] * 2;
+  if (*end > font->font + font->font_len) {
+    return NULL;
+  }
+  return glyph;
+}
+
+static mp_obj_t st7789_ST7789_draw(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  hershey_font_t font;
+  hershey_font(args[1], &font);
+
+  size_t len;
+  uint8_t chr;
+  const uint8_t *str = string_arg(args[2], &len, &chr);
+  mp_int_t x = mp_obj_get_int(args[3]);
+  mp_int_t y = mp_obj_get_int(args[4]);
+  mp_int_t color = (n_args > 5) ? mp_obj_get_int(args[5]) : WHITE;
+  float scale = (n_args > 6) ? mp_obj_get_float(args[6]) : 1.0f;
+  float angle = (n_args > 7) ? mp_obj_get_float(args[7]) : 0;
+
+  // glyph space to screen: advance along the baseline, then rotate
+  float cos_a = cosf(angle) * scale;
+  float sin_a = sinf(angle) * scale;
+  int pos = 0; // pen position along the baseline, unscaled
+
+  for (size_t i = 0; i < len; i++) {
+    const uint8_t *end;
+    const uint8_t *glyph = hershey_glyph(&font, str[i], &end);
+    if (glyph == NULL) {
+      continue;
+    }
+
+    int left = glyph[1] - HERSHEY_BIAS;
+    int right = glyph[2] - HERSHEY_BIAS;
+    bool penup = true;
+    int16_t from_x = 0, from_y = 0;
+
+    for (const uint8_t *v = glyph + 3; v < end; v += 2) {
+      if (v[0] == ' ') {
+        penup = true;
+        continue;
+      }
+      float vx = pos + v[0] - HERSHEY_BIAS - left;
+      float vy = v[1] - HERSHEY_BIAS;
+      int16_t to_x = x + lroundf(vx * cos_a - vy * sin_a);
+      int16_t to_y = y + lroundf(vx * sin_a + vy * cos_a);
+      if (!penup) {
+        line(self, from_x, from_y, to_x, to_y, color);
+      }
+      from_x = to_x;
+      from_y = to_y;
+      penup = false;
+    }
+    pos += right - left;
+  }
+
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_draw_obj, 5, 8,
+                                           st7789_ST7789_draw);
+
+static mp_obj_t st7789_ST7789_draw_len(size_t n_args, const mp_obj_t *args) {
+  hershey_font_t font;
+  hershey_font(args[1], &font);
+
+  size_t len;
+  uint8_t chr;
+  const uint8_t *str = string_arg(args[2], &len, &chr);
+  float scale = (n_args > 3) ? mp_obj_get_float(args[3]) : 1.0f;
+
+  int width = 0;
+  for (size_t i = 0; i < len; i++) {
+    const uint8_t *end;
+    const uint8_t *glyph = hershey_glyph(&font, str[i], &end);
+    if (glyph) {
+      width += glyph[2] - glyph[1];
+    }
+  }
+  return mp_obj_new_int(lroundf(width * scale));
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_draw_len_obj, 3, 4,
+                                           st7789_ST7789_draw_len);
+
+//
+// Compressed images
+//
+// blit_rle() takes RGB565 pixels packed in PackBits style packets. A header
+// byte n with the top bit set is followed by one big endian pixel repeated
+// (n & 0x7F) + 1 times, otherwise it is followed by n + 1 literal pixels.
+//
+
+static mp_obj_t st7789_ST7789_blit_rle(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_buffer_info_t buf_info;
+  mp_get_buffer_raise(args[1], &buf_info, MP_BUFFER_READ);
+  mp_int_t x = mp_obj_get_int(args[2]);
+  mp_int_t y = mp_obj_get_int(args[3]);
+  mp_int_t w = mp_obj_get_int(args[4]);
+  mp_int_t h = mp_obj_get_int(args[5]);
+
+  const uint8_t *data = buf_info.buf;
+  const uint8_t *end = data + buf_info.len;
+
+  st7789_stream_t stream;
+  stream_begin(self, &stream, x, y, w, h);
+  while (data < end && !stream_done(&stream)) {
+    uint8_t header = *data++;
+    size_t count = (header & 0x7F) + 1;
+    if (header & 0x80) {
+      if (end - data < 2) {
+        break;
+      }
+      stream_run(self, &stream, (data[0] << 8) | data[1], count);
+      data += 2;
+    } else {
+      count = MIN(count, (size_t)(end - data) / 2);
+      for (size_t i = 0; i < count; i++, data += 2) {
+        stream_pixel(self, &stream, (data[0] << 8) | data[1]);
+      }
+    }
+  }
+  stream_end(self, &stream);
+
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_blit_rle_obj, 6, 6,
+                                           st7789_ST7789_blit_rle);
+
+//
+// Indexed images
+//
+// blit_indexed() takes rows of 1, 2, 4 or 8 bit palette indexes packed most
+// significant bits first, each row starting on a byte boundary. Whole bytes
+// are expanded with table lookups straight into the transfer buffer or the
+// frame buffer.
+//
+
+static void load_palette(st7789_palette_t *palette, mp_obj_t colors_obj,
+                         int bpp) {
+  size_t len;
+  mp_obj_t *colors;
+  mp_obj_get_array(colors_obj, &len, &colors);
+
+  size_t size = 1 << bpp;
+  for (size_t i = 0; i < size; i++) {
+    uint16_t color = (i < len) ? mp_obj_get_int(colors[i]) : 0;
+    palette->colors[i] = _swap_bytes(color);
+  }
+
+  if (bpp < 4) {
+    int per_nibble = 4 / bpp;
+    int mask = size - 1;
+    for (int nibble = 0; nibble < 16; nibble++) {
+      for (int i = 0; i < per_nibble; i++) {
+        int shift = 4 - bpp * (i + 1);
+        palette->nibbles[nibble][i] = palette->colors[(nibble >> shift) & mask];
+      }
+    }
+  }
+}
+
+static inline uint16_t indexed_pixel(const st7789_palette_t *palette,
+                                     const uint8_t *row, size_t i, int bpp) {
+  size_t bit = i * bpp;
+  int index = (row[bit >> 3] >> (8 - bpp - (bit & 7))) & ((1 << bpp) - 1);
+  return palette->colors[index];
+}
+
+// expand count pixels of a row starting at pixel first
+static void expand_indexed(uint16_t *dst, const st7789_palette_t *palette,
+                           const uint8_t *row, size_t first, size_t count,
+                           int bpp) {
+  size_t i = first, end = first + count;
+
+  // pixels up to a byte boundary
+  while (i < end && ((i * bpp) & 7)) {
+    *dst++ = indexed_pixel(palette, row, i++, bpp);
+  }
+
+  const uint8_t *src = row + i * bpp / 8;
+  size_t bytes = (end - i) * bpp / 8;
+  i += bytes * 8 / bpp;
+  switch (bpp) {
+  case 8:
+    for (size_t k = 0; k < bytes; k++) {
+      *dst++ = palette->colors[src[k]];
+    }
+    break;
+  case 4:
+    for (size_t k = 0; k < bytes; k++) {
+      *dst++ = palette->colors[src[k] >> 4];
+      *dst++ = palette->colors[src[k] & 0x0F];
+    }
+    break;
+  default: {
+    int per_nibble = 4 / bpp;
+    for (size_t k = 0; k < bytes; k++) {
+      memcpy(dst, palette->nibbles[src[k] >> 4], per_nibble * 2);
+      dst += per_nibble;
+      memcpy(dst, palette->nibbles[src[k] & 0x0F], per_nibble * 2);
+      dst += per_nibble;
+    }
+    break;
+  }
+  }
+
+  // pixels of the last partial byte
+  while (i < end) {
+    *dst++ = indexed_pixel(palette, row, i++, bpp);
+  }
+}
+
+static mp_obj_t st7789_ST7789_blit_indexed(size_t n_args,
+                                           const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_buffer_info_t buf_info;
+  mp_get_buffer_raise(args[1], &buf_info, MP_BUFFER_READ);
+  mp_int_t x = mp_obj_get_int(args[2]);
+  mp_int_t y = mp_obj_get_int(args[3]);
+  mp_int_t w = mp_obj_get_int(args[4]);
+  mp_int_t h = mp_obj_get_int(args[5]);
+  mp_int_t bpp = mp_obj_get_int(args[6]);
+
+  if (bpp != 1 && bpp != 2 && bpp != 4 && bpp != 8) {
+    mp_raise_ValueError(MP_ERROR_TEXT("bpp must be 1, 2, 4 or 8"));
+  }
+  if (w <= 0 || h <= 0) {
+    return mp_const_none;
+  }
+  size_t stride = (w * bpp + 7) / 8;
+  if (buf_info.len < stride * h) {
+    mp_raise_ValueError(MP_ERROR_TEXT("buffer too small"));
+  }
+
+  int x0 = MAX(x, 0);
+  int y0 = MAX(y, 0);
+  int x1 = MIN(x + w - 1, self->width - 1);
+  int y1 = MIN(y + h - 1, self->height - 1);
+  if (x0 > x1 || y0 > y1) {
+    return mp_const_none;
+  }
+
+  st7789_palette_t palette;
+  load_palette(&palette, args[7], bpp);
+
+  const uint8_t *data = (const uint8_t *)buf_info.buf + (y0 - y) * stride;
+  size_t first = x0 - x;
+  size_t count = x1 - x0 + 1;
+
+  if (self->frame_buffer) {
+    frame_buffer_wait(self);
+    for (int row = y0; row <= y1; row++, data += stride) {
+      expand_indexed(&self->frame_buffer[row * self->width + x0], &palette,
+                     data, first, count, bpp);
+    }
+    mark_dirty(self, x0, y0, x1, y1);
+    return mp_const_none;
+  }
+
+  set_window(self, x0, y0, x1, y1);
+  size_t capacity = buffer_pixels(self);
+  size_t len = 0;
+  for (int row = y0; row <= y1; row++, data += stride) {
+    for (size_t done = 0; done < count;) {
+      size_t n = MIN(count - done, capacity - len);
+      expand_indexed(&self->buffer[len], &palette, data, first + done, n, bpp);
+      len += n;
+      done += n;
+      if (len == capacity) {
+        write_buffer(self, len);
+        len = 0;
+      }
+    }
+  }
+  if (len) {
+    write_buffer(self, len);
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_blit_indexed_obj, 8,
+                                           8, st7789_ST7789_blit_indexed);
+
+//
+// Scaled images
+//
+// blit_scaled() resamples with nearest neighbour, picking the source pixel
+// under the centre of each destination pixel. The position steps in whole
+// pixels plus a fraction kept as an exact remainder, so there is no drift
+// across wide images. Rows are built straight into the transfer buffer or
+// the frame buffer, and a row that repeats the source row of the one before
+// it is copied instead.
+//
+
+// source position for successive destination pixels
+typedef struct _scale_step_t {
+  size_t pos;    // source pixel
+  uint32_t rem;  // fraction of a pixel, in units of 1 / den
+  size_t whole;  // whole pixels per step
+  uint32_t part; // fraction per step
+  uint32_t den;
+} scale_step_t;
+
+static void scale_start(scale_step_t *step, int src, int dst, size_t first) {
+  // the centre of destination pixel i is at (2 * i + 1) * src / (2 * dst)
+  uint64_t num = (uint64_t)(2 * first + 1) * src;
+  step->den = 2 * dst;
+  step->pos = num / step->den;
+  step->rem = num % step->den;
+  step->whole = src / dst;
+  step->part = 2 * (src % dst);
+}
+
+static inline void scale_next(scale_step_t *step) {
+  step->pos += step->whole;
+  step->rem += step->part;
+  if (step->rem >= step->den) {
+    step->rem -= step->den;
+    step->pos++;
+  }
+}
+
+// pixels first..first + count - 1 of a destination row, byte swapped
+static void scale_row(uint16_t *dst, const uint8_t *row, int src_w, int dst_w,
+                      size_t first, size_t count) {
+  if (dst_w % src_w == 0) {
+    // integer factor: repeat each pixel
+    int factor = dst_w / src_w;
+    const uint8_t *p = row + first / factor * 2;
+    size_t repeat = factor - first % factor;
+    while (count) {
+      uint16_t color = p[0] | (p[1] << 8);
+      size_t n = MIN(repeat, count);
+      for (size_t i = 0; i < n; i++) {
+        *dst++ = color;
+      }
+      count -= n;
+      p += 2;
+      repeat = factor;
+    }
+    return;
+  }
+
+  scale_step_t step;
+  scale_start(&step, src_w, dst_w, first);
+  for (size_t i = 0; i < count; i++, scale_next(&step)) {
+    const uint8_t *p = row + step.pos * 2;
+    *dst++ = p[0] | (p[1] << 8);
+  }
+}
+
+static mp_obj_t st7789_ST7789_blit_scaled(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_buffer_info_t buf_info;
+  mp_get_buffer_raise(args[1], &buf_info, MP_BUFFER_READ);
+  mp_int_t src_w = mp_obj_get_int(args[2]);
+  mp_int_t src_h = mp_obj_get_int(args[3]);
+  mp_int_t x = mp_obj_get_int(args[4]);
+  mp_int_t y = mp_obj_get_int(args[5]);
+  mp_int_t dst_w = mp_obj_get_int(args[6]);
+  mp_int_t dst_h = mp_obj_get_int(args[7]);
+
+  if (src_w <= 0 || src_h <= 0 || dst_w <= 0 || dst_h <= 0) {
+    return mp_const_none;
+  }
+  size_t stride = src_w * 2;
+  if (buf_info.len < stride * src_h) {
+    mp_raise_ValueError(MP_ERROR_TEXT("buffer too small"));
+  }
+
+  int x0 = MAX(x, 0);
+  int y0 = MAX(y, 0);
+  int x1 = MIN(x + dst_w - 1, self->width - 1);
+  int y1 = MIN(y + dst_h - 1, self->height - 1);
+  if (x0 > x1 || y0 > y1) {
+    return mp_const_none;
+  }
+
+  const uint8_t *data = (const uint8_t *)buf_info.buf;
+  size_t first = x0 - x;
+  size_t count = x1 - x0 + 1;
+  scale_step_t step;
+  scale_start(&step, src_h, dst_h, y0 - y);
+  int prev = -1; // source row of the row before
+
+  if (self->frame_buffer) {
+    frame_buffer_wait(self);
+    for (int row = y0; row <= y1; row++, scale_next(&step)) {
+      uint16_t *dst = &self->frame_buffer[row * self->width + x0];
+      int src_row = step.pos;
+      if (src_row == prev) {
+        memcpy(dst, dst - self->width, count * 2);
+      } else {
+        scale_row(dst, data + src_row * stride, src_w, dst_w, first, count);
+      }
+      prev = src_row;
+    }
+    mark_dirty(self, x0, y0, x1, y1);
+    return mp_const_none;
+  }
+
+  set_window(self, x0, y0, x1, y1);
+  size_t capacity = buffer_pixels(self);
+  size_t len = 0;
+  if (count > capacity || is_12bit(self)) {
+    // rows go out in pieces when they are longer than the buffer, or when
+    // packing to 12-bit needs the buffer full
+    for (int row = y0; row <= y1; row++, scale_next(&step)) {
+      const uint8_t *src = data + step.pos * stride;
+      for (size_t done = 0; done < count;) {
+        size_t n = MIN(count - done, capacity - len);
+        scale_row(&self->buffer[len], src, src_w, dst_w, first + done, n);
+        len += n;
+        done += n;
+        if (len == capacity) {
+          write_buffer(self, len);
+          len = 0;
+        }
+      }
+    }
+  } else {
+    // whole rows, the row before is still at last after it was sent
+    size_t last = 0;
+    for (int row = y0; row <= y1; row++, scale_next(&step)) {
+      int src_row = step.pos;
+      if (capacity - len < count) {
+        write_buffer(self, len);
+        len = 0;
+      }
+      if (src_row == prev) {
+        memmove(&self->buffer[len], &self->buffer[last], count * 2);
+      } else {
+        scale_row(&self->buffer[len], data + src_row * stride, src_w, dst_w,
+                  first, count);
+      }
+      prev = src_row;
+      last = len;
+      len += count;
+    }
+  }
+  if (len) {
+    write_buffer(self, len);
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_blit_scaled_obj, 8, 8,
+                                           st7789_ST7789_blit_scaled);
+
+//
+// Rotated images
+//
+// blit_rotated() walks the scanlines of the rotated image's bounding box and
+// maps each pixel centre back into the image in 16.16 fixed point. Runs of
+// pixels that land inside the image and are not transparent are collected in
+// the transfer buffer and sent through a window of their own, so gaps cost
+// nothing.
+//
+
+// send the n pixels in the transfer buffer as a run starting at x, y
+static void rotated_run(st7789_ST7789_obj_t *self, int x, int y, size_t n) {
+  if (self->frame_buffer) {
+    memcpy(&self->frame_buffer[y * self->width + x], self->buffer, n * 2);
+    mark_dirty(self, x, y, x + n - 1, y);
+  } else {
+    set_window(self, x, y, x + n - 1, y);
+    write_buffer(self, n);
+  }
+}
+
+static mp_obj_t st7789_ST7789_blit_rotated(size_t n_args,
+                                           const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_buffer_info_t buf_info;
+  mp_get_buffer_raise(args[1], &buf_info, MP_BUFFER_READ);
+  mp_int_t w = mp_obj_get_int(args[2]);
+  mp_int_t h = mp_obj_get_int(args[3]);
+  mp_obj_t *pivot;
+  mp_obj_get_array_fixed_n(args[4], 2, &pivot);
+  float pivot_x = mp_obj_get_float(pivot[0]);
+  float pivot_y = mp_obj_get_float(pivot[1]);
+  float angle = mp_obj_get_float(args[5]);
+  mp_int_t x = mp_obj_get_int(args[6]);
+  mp_int_t y = mp_obj_get_int(args[7]);
+  int32_t key = (n_args > 8 && args[8] != mp_const_none)
+                    ? _swap_bytes(mp_obj_get_int(args[8]))
+                    : -1;
+
+  if (w <= 0 || h <= 0) {
+    return mp_const_none;
+  }
+  if (w > 0x7FFF || h > 0x7FFF) {
+    mp_raise_ValueError(MP_ERROR_TEXT("image too large"));
+  }
+  if (buf_info.len < (size_t)(w * h * 2)) {
+    mp_raise_ValueError(MP_ERROR_TEXT("buffer too small"));
+  }
+
+  // bounding box of the rotated corners, the pivot lands on x, y
+  float cos_a = cosf(angle);
+  float sin_a = sinf(angle);
+  float min_x = INFINITY, min_y = INFINITY;
+  float max_x = -INFINITY, max_y = -INFINITY;
+  for (int corner = 0; corner < 4; corner++) {
+    float cx = ((corner & 1) ? w : 0) - pivot_x;
+    float cy = ((corner & 2) ? h : 0) - pivot_y;
+    float rx = cx * cos_a - cy * sin_a;
+    float ry = cx * sin_a + cy * cos_a;
+    min_x = MIN(min_x, rx);
+    max_x = MAX(max_x, rx);
+    min_y = MIN(min_y, ry);
+    max_y = MAX(max_y, ry);
+  }
+  int x0 = MAX(x + (int)floorf(min_x), 0);
+  int y0 = MAX(y + (int)floorf(min_y), 0);
+  int x1 = MIN(x + (int)ceilf(max_x), self->width - 1);
+  int y1 = MIN(y + (int)ceilf(max_y), self->height - 1);
+  if (x0 > x1 || y0 > y1) {
+    return mp_const_none;
+  }
+
+  // image position of a display pixel centre is the inverse rotation of its
+  // offset from the pivot, stepping by (cos, -sin) along a scanline
+  const uint8_t *data = (const uint8_t *)buf_info.buf;
+  uint32_t limit_u = (uint32_t)w << 16;
+  uint32_t limit_v = (uint32_t)h << 16;
+  int32_t du = lroundf(cos_a * 65536.0f);
+  int32_t dv = lroundf(-sin_a * 65536.0f);
+  size_t capacity = buffer_pixels(self);
+
+  // runs are gathered before their window is set, so a queued fill must be
+  // done with the scratch buffer first
+  async_wait(self);
+  for (int row = y0; row <= y1; row++) {
+    float ox = x0 + 0.5f - x;
+    float oy = row + 0.5f - y;
+    int32_t u = lroundf((ox * cos_a + oy * sin_a + pivot_x) * 65536.0f);
+    int32_t v = lroundf((-ox * sin_a + oy * cos_a + pivot_y) * 65536.0f);
+    size_t len = 0;
+    int start = x0;
+    for (int col = x0; col <= x1; col++, u += du, v += dv) {
+      bool inside = (uint32_t)u < limit_u && (uint32_t)v < limit_v;
+      if (inside) {
+        const uint8_t *p = data + ((v >> 16) * w + (u >> 16)) * 2;
+        uint16_t color = p[0] | (p[1] << 8);
+        if (color != key) {
+          if (len == 0) {
+            start = col;
+          }
+          self->buffer[len++] = color;
+          if (len < capacity) {
+            continue;
+          }
+        }
+      }
+      // a gap or a full buffer ends the run
+      if (len) {
+        rotated_run(self, start, row, len);
+        len = 0;
+      }
+    }
+    if (len) {
+      rotated_run(self, start, row, len);
+    }
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_blit_rotated_obj, 8,
+                                           9, st7789_ST7789_blit_rotated);
+
+//
+// Alpha blending
+//
+// Blended drawing needs the colors underneath, which the display can't send
+// back: they come from the frame buffer or from a single background color.
+// blend_color() scales red and blue with one multiply by moving red up to
+// the top half of a 32-bit word, leaving room between the two channels for
+// the products, and green with a second.
+//
+
+// fg over bg, alpha 0 to 255
+static inline uint16_t blend_color(uint16_t fg, uint16_t bg, uint8_t alpha) {
+  uint32_t a = alpha + (alpha >> 7); // 0 to 256
+  uint32_t f = ((fg & 0xF800) << 5) | (fg & 0x001F);
+  uint32_t b = ((bg & 0xF800) << 5) | (bg & 0x001F);
+  uint32_t rb = (b + (((f - b) * a + 0x00800080) >> 8)) & 0x001F001F;
+  f = fg & 0x07E0;
+  b = bg & 0x07E0;
+  uint32_t g = (b + (((f - b) * a + 0x00001000) >> 8)) & 0x07E0;
+  return (rb >> 5) | (rb & 0x001F) | g;
+}
+
+// Blend a w by h area at x, y. The pixels are the big endian RGB565 image,
+// or color when image is NULL, with alpha from the mask of one byte per
+// pixel, or the constant alpha when mask is NULL. They are blended over the
+// color bg, or over the frame buffer when bg is negative.
+static void blend_area(st7789_ST7789_obj_t *self, const uint8_t *image,
+                       uint16_t color, const uint8_t *mask, uint8_t alpha,
+                       int x, int y, int w, int h, int bg) {
+  int x0 = MAX(x, 0);
+  int y0 = MAX(y, 0);
+  int x1 = MIN(x + w - 1, self->width - 1);
+  int y1 = MIN(y + h - 1, self->height - 1);
+  if (x0 > x1 || y0 > y1) {
+    return;
+  }
+
+  if (image == NULL && mask == NULL && bg >= 0) {
+    // one color over one color
+    fill_rect(self, x0, y0, x1 - x0 + 1, y1 - y0 + 1,
+              blend_color(color, bg, alpha));
+    return;
+  }
+
+  size_t count = x1 - x0 + 1;
+  size_t capacity = buffer_pixels(self);
+  size_t len = 0;
+  if (self->frame_buffer) {
+    frame_buffer_wait(self);
+  } else {
+    set_window(self, x0, y0, x1, y1);
+  }
+  for (int row = y0; row <= y1; row++) {
+    size_t offset = (row - y) * w + (x0 - x);
+    const uint8_t *src = image ? image + offset * 2 : NULL;
+    const uint8_t *a = mask ? mask + offset : NULL;
+    uint16_t *under = self->frame_buffer
+                          ? &self->frame_buffer[row * self->width + x0]
+                          : NULL;
+    for (size_t i = 0; i < count; i++) {
+      uint16_t fg = src ? (src[i * 2] << 8) | src[i * 2 + 1] : color;
+      uint16_t back = (bg >= 0) ? bg : _swap_bytes(under[i]);
+      uint16_t mix = _swap_bytes(blend_color(fg, back, a ? a[i] : alpha));
+      if (under) {
+        under[i] = mix;
+        continue;
+      }
+      self->buffer[len++] = mix;
+      if (len == capacity) {
+        write_buffer(self, len);
+        len = 0;
+      }
+    }
+  }
+  if (len) {
+    write_buffer(self, len);
+  }
+  if (self->frame_buffer) {
+    mark_dirty(self, x0, y0, x1, y1);
+  }
+}
+
+// the background argument, or -1 to blend over the frame buffer
+static int blend_bg(st7789_ST7789_obj_t *self, size_t n_args,
+                    const mp_obj_t *args, size_t index) {
+  if (n_args > index && args[index] != mp_const_none) {
+    return mp_obj_get_int(args[index]) & 0xFFFF;
+  }
+  if (self->frame_buffer == NULL) {
+    mp_raise_ValueError(MP_ERROR_TEXT("bg is needed without a frame buffer"));
+  }
+  return -1;
+}
+
+static mp_obj_t st7789_ST7789_blit_alpha(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_buffer_info_t buf_info;
+  mp_get_buffer_raise(args[1], &buf_info, MP_BUFFER_READ);
+  mp_int_t x = mp_obj_get_int(args[3]);
+  mp_int_t y = mp_obj_get_int(args[4]);
+  mp_int_t w = mp_obj_get_int(args[5]);
+  mp_int_t h = mp_obj_get_int(args[6]);
+  int bg = blend_bg(self, n_args, args, 7);
+
+  if (w <= 0 || h <= 0) {
+    return mp_const_none;
+  }
+  if (w > 0x7FFF || h > 0x7FFF) {
+    mp_raise_ValueError(MP_ERROR_TEXT("image too large"));
+  }
+  if (buf_info.len < (size_t)w * h * 2) {
+    mp_raise_ValueError(MP_ERROR_TEXT("buffer too small"));
+  }
+
+  // a constant alpha or a mask of one byte per pixel
+  const uint8_t *mask = NULL;
+  uint8_t alpha = 0;
+  if (mp_obj_is_int(args[2])) {
+    alpha = MIN(MAX(mp_obj_get_int(args[2]), 0), 255);
+  } else {
+    mp_buffer_info_t mask_info;
+    mp_get_buffer_raise(args[2], &mask_info, MP_BUFFER_READ);
+    if (mask_info.len < (size_t)w * h) {
+      mp_raise_ValueError(MP_ERROR_TEXT("alpha mask too small"));
+    }
+    mask = mask_info.buf;
+  }
+
+  blend_area(self, buf_info.buf, 0, mask, alpha, x, y, w, h, bg);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_blit_alpha_obj, 7, 8,
+                                           st7789_ST7789_blit_alpha);
+
+static mp_obj_t st7789_ST7789_fill_rect_alpha(size_t n_args,
+                                              const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t x = mp_obj_get_int(args[1]);
+  mp_int_t y = mp_obj_get_int(args[2]);
+  mp_int_t w = mp_obj_get_int(args[3]);
+  mp_int_t h = mp_obj_get_int(args[4]);
+  mp_int_t color = mp_obj_get_int(args[5]);
+  mp_int_t alpha = mp_obj_get_int(args[6]);
+  int bg = blend_bg(self, n_args, args, 7);
+
+  blend_area(self, NULL, color, NULL, MIN(MAX(alpha, 0), 255), x, y, w, h,
+             bg);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_fill_rect_alpha_obj,
+                                           7, 8, st7789_ST7789_fill_rect_alpha);
+
+//
+// Gradients and patterns
+//
+// Both are generated a pixel at a time into one clipped pixel stream, so a
+// fill is one window and one transfer however many rows it covers. Gradient
+// channels are stepped in 16.16 fixed point in RGB565 units; dithering adds
+// a 4x4 Bayer threshold to the fraction in place of rounding, which hides the
+// bands between the few levels of red and blue.
+//
+
+static const uint8_t bayer4[4][4] = {
+    {0, 8, 2, 10}, {12, 4, 14, 6}, {3, 11, 1, 9}, {15, 7, 13, 5}};
+
+typedef struct _gradient_t {
+  int32_t value[3]; // red, green and blue
+  int32_t step[3];
+} gradient_t;
+
+// channels for position pos of the n steps from c0 to c1
+static void gradient_start(gradient_t *g, uint16_t c0, uint16_t c1, int n,
+                           int pos) {
+  static const uint8_t shift[3] = {11, 5, 0};
+  static const uint8_t mask[3] = {0x1F, 0x3F, 0x1F};
+  for (int i = 0; i < 3; i++) {
+    int32_t from = (c0 >> shift[i]) & mask[i];
+    int32_t to = (c1 >> shift[i]) & mask[i];
+    g->step[i] = (n > 1) ? (to - from) * 65536 / (n - 1) : 0;
+    g->value[i] = (from << 16) + g->step[i] * pos;
+  }
+}
+
+static inline void gradient_next(gradient_t *g) {
+  g->value[0] += g->step[0];
+  g->value[1] += g->step[1];
+  g->value[2] += g->step[2];
+}
+
+// the color at the current position, bias is the fraction rounded up
+static inline uint16_t gradient_color(const gradient_t *g, int32_t bias) {
+  return ((g->value[0] + bias) >> 16) << 11 |
+         ((g->value[1] + bias) >> 16) << 5 | ((g->value[2] + bias) >> 16);
+}
+
+// rounding, or the dither threshold for x, y
+static inline int32_t gradient_bias(int flags, int x, int y) {
+  if (flags & GRADIENT_DITHER) {
+    return (bayer4[y & 3][x & 3] << 12) + (1 << 11);
+  }
+  return 1 << 15;
+}
+
+static mp_obj_t st7789_ST7789_fill_gradient(size_t n_args,
+                                            const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t x = mp_obj_get_int(args[1]);
+  mp_int_t y = mp_obj_get_int(args[2]);
+  mp_int_t w = mp_obj_get_int(args[3]);
+  mp_int_t h = mp_obj_get_int(args[4]);
+  uint16_t c0 = mp_obj_get_int(args[5]);
+  uint16_t c1 = mp_obj_get_int(args[6]);
+  mp_int_t flags = (n_args > 7) ? mp_obj_get_int(args[7]) : GRADIENT_H;
+
+  if (flags & ~(GRADIENT_V | GRADIENT_DITHER)) {
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid direction"));
+  }
+
+  int x0 = MAX(x, 0);
+  int y0 = MAX(y, 0);
+  int x1 = MIN(x + w - 1, self->width - 1);
+  int y1 = MIN(y + h - 1, self->height - 1);
+  if (w <= 0 || h <= 0 || x0 > x1 || y0 > y1) {
+    return mp_const_none;
+  }
+
+  st7789_stream_t stream;
+  stream_begin(self, &stream, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+  gradient_t g;
+  if (flags & GRADIENT_V) {
+    gradient_start(&g, c0, c1, h, y0 - y);
+    for (int row = y0; row <= y1; row++, gradient_next(&g)) {
+      if (!(flags & GRADIENT_DITHER)) {
+        stream_run(self, &stream, gradient_color(&g, 1 << 15), x1 - x0 + 1);
+        continue;
+      }
+      for (int col = x0; col <= x1; col++) {
+        stream_pixel(self, &stream,
+                     gradient_color(&g, gradient_bias(flags, col, row)));
+      }
+    }
+  } else {
+    for (int row = y0; row <= y1; row++) {
+      gradient_start(&g, c0, c1, w, x0 - x);
+      for (int col = x0; col <= x1; col++, gradient_next(&g)) {
+        stream_pixel(self, &stream,
+                     gradient_color(&g, gradient_bias(flags, col, row)));
+      }
+    }
+  }
+  stream_end(self, &stream);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_fill_gradient_obj, 7,
+                                           8, st7789_ST7789_fill_gradient);
+
+// fill a rectangle with copies of a small RGB565 image, the first copy with
+// its top left corner at x, y
+static mp_obj_t st7789_ST7789_fill_pattern(size_t n_args,
+                                           const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_buffer_info_t buf_info;
+  mp_get_buffer_raise(args[1], &buf_info, MP_BUFFER_READ);
+  mp_int_t pw = mp_obj_get_int(args[2]);
+  mp_int_t ph = mp_obj_get_int(args[3]);
+  mp_int_t x = mp_obj_get_int(args[4]);
+  mp_int_t y = mp_obj_get_int(args[5]);
+  mp_int_t w = mp_obj_get_int(args[6]);
+  mp_int_t h = mp_obj_get_int(args[7]);
+
+  if (pw <= 0 || ph <= 0 || pw > 0x7FFF || ph > 0x7FFF) {
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid pattern size"));
+  }
+  if (buf_info.len < (size_t)pw * ph * 2) {
+    mp_raise_ValueError(MP_ERROR_TEXT("buffer too small"));
+  }
+
+  int x0 = MAX(x, 0);
+  int y0 = MAX(y, 0);
+  int x1 = MIN(x + w - 1, self->width - 1);
+  int y1 = MIN(y + h - 1, self->height - 1);
+  if (w <= 0 || h <= 0 || x0 > x1 || y0 > y1) {
+    return mp_const_none;
+  }
+
+  const uint8_t *data = (const uint8_t *)buf_info.buf;
+  st7789_stream_t stream;
+  stream_begin(self, &stream, x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+  for (int row = y0; row <= y1; row++) {
+    const uint8_t *line = data + ((row - y) % ph) * pw * 2;
+    int col = (x0 - x) % pw;
+    for (int i = x0; i <= x1; i++) {
+      stream_pixel(self, &stream, (line[col * 2] << 8) | line[col * 2 + 1]);
+      if (++col == pw) {
+        col = 0;
+      }
+    }
+  }
+  stream_end(self, &stream);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_fill_pattern_obj, 8, 8,
+                                           st7789_ST7789_fill_pattern);
+
+//
+// Image files
+//
+// The decoders pull data through image_read() from a file name, an open
+// stream or bytes, and hand back small blocks of pixels that go out through
+// the pixel stream, so only the decoder state is held in RAM.
+//
+
+static void image_open(st7789_ST7789_obj_t *self, st7789_image_io_t *io,
+                       mp_obj_t source, int x, int y) {
+  io->self = self;
+  io->file = MP_OBJ_NULL;
+  io->data = NULL;
+  io->len = 0;
+  io->pos = 0;
+  io->error = 0;
+  io->x = x;
+  io->y = y;
+  io->bg = -1;
+
+  mp_buffer_info_t bufinfo;
+  if (mp_obj_is_str(source)) {
+    mp_obj_t args[2] = {source, MP_OBJ_NEW_QSTR(MP_QSTR_rb)};
+    io->file = mp_builtin_open(2, args, (mp_map_t *)&mp_const_empty_map);
+  } else if (mp_get_buffer(source, &bufinfo, MP_BUFFER_READ)) {
+    io->data = bufinfo.buf;
+    io->len = bufinfo.len;
+  } else {
+    mp_get_stream_raise(source, MP_STREAM_OP_READ);
+    io->file = source;
+  }
+}
+
+// close a file opened by name
+static void image_close_file(st7789_image_io_t *io, mp_obj_t source) {
+  if (io->file != MP_OBJ_NULL && io->file != source) {
+    mp_stream_close(io->file);
+  }
+}
+
+// close a file opened by name and raise any stream error
+static void image_close(st7789_image_io_t *io, mp_obj_t source) {
+  image_close_file(io, source);
+  if (io->error) {
+    mp_raise_OSError(io->error);
+  }
+}
+
+static size_t image_read(void *ctx, uint8_t *buf, size_t len) {
+  st7789_image_io_t *io = ctx;
+  if (io->file != MP_OBJ_NULL) {
+    if (io->error) {
+      return 0;
+    }
+    int errcode;
+    mp_uint_t n =
+        mp_stream_rw(io->file, buf, len, &errcode, MP_STREAM_RW_READ);
+    if (errcode) {
+      io->error = errcode;
+      return 0;
+    }
+    return n;
+  }
+  size_t n = MIN(len, io->len - io->pos);
+  memcpy(buf, io->data + io->pos, n);
+  io->pos += n;
+  return n;
+}
+
+static void image_write(void *ctx, int x, int y, int w, int h,
+                        const uint16_t *pixels, int stride) {
+  st7789_image_io_t *io = ctx;
+  st7789_stream_t stream;
+  stream_begin(io->self, &stream, io->x + x, io->y + y, w, h);
+  for (int row = 0; row < h && !stream_done(&stream); row++) {
+    for (int col = 0; col < w; col++) {
+      stream_pixel(io->self, &stream, pixels[row * stride + col]);
+    }
+  }
+  stream_end(io->self, &stream);
+}
+
+static void jpg_raise(int result) {
+  switch (result) {
+  case JPG_ERR_READ:
+    mp_raise_ValueError(MP_ERROR_TEXT("jpg data ended early"));
+  case JPG_ERR_UNSUPPORTED:
+    mp_raise_ValueError(MP_ERROR_TEXT("unsupported jpg format"));
+  case JPG_ERR_FORMAT:
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid jpg data"));
+  }
+}
+
+static mp_obj_t st7789_ST7789_jpg(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t x = mp_obj_get_int(args[2]);
+  mp_int_t y = mp_obj_get_int(args[3]);
+  mp_int_t scale = (n_args > 4) ? mp_obj_get_int(args[4]) : 1;
+
+  if (scale != 1 && scale != 2 && scale != 4 && scale != 8) {
+    mp_raise_ValueError(MP_ERROR_TEXT("scale must be 1, 2, 4 or 8"));
+  }
+
+  st7789_image_io_t io;
+  image_open(self, &io, args[1], x, y);
+
+  // volatile, the handler reads it after a raise
+  jpg_t *volatile jpg = NULL;
+  int result;
+  nlr_buf_t nlr;
+  if (nlr_push(&nlr) == 0) {
+    jpg = m_new(jpg_t, 1);
+    result = jpg_open(jpg, image_read, &io);
+    if (result == JPG_OK) {
+      result = jpg_decode(jpg, scale, image_write, &io);
+    }
+    nlr_pop();
+  } else {
+    // out of memory or a write raised, don't leave the file open
+    if (jpg) {
+      m_del(jpg_t, jpg, 1);
+    }
+    image_close_file(&io, args[1]);
+    nlr_jump(nlr.ret_val);
+  }
+  m_del(jpg_t, jpg, 1);
+
+  image_close(&io, args[1]);
+  jpg_raise(result);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_jpg_obj, 4, 5,
+                                           st7789_ST7789_jpg);
+
+// rows of opaque images and images blended against a background color go
+// out through one stream for the whole image, otherwise each run of opaque
+// pixels gets its own window
+static void image_write_row(void *ctx, int y, const uint16_t *pixels,
+                            const uint8_t *alpha, int width) {
+  st7789_image_io_t *io = ctx;
+  st7789_ST7789_obj_t *self = io->self;
+
+  if (alpha == NULL || io->bg >= 0) {
+    if (stream_done(&io->stream)) {
+      return;
+    }
+    for (int x = 0; x < width; x++) {
+      uint16_t color = pixels[x];
+      if (alpha && alpha[x] != 0xFF) {
+        color = blend_color(color, io->bg, alpha[x]);
+      }
+      stream_pixel(self, &io->stream, color);
+    }
+    return;
+  }
+
+  if (io->y + y < 0 || io->y + y >= self->height) {
+    return;
+  }
+  for (int x = 0; x < width;) {
+    if (alpha[x] < 0x80) {
+      x++;
+      continue;
+    }
+    int start = x;
+    while (x < width && alpha[x] >= 0x80) {
+      x++;
+    }
+    st7789_stream_t run;
+    stream_begin(self, &run, io->x + start, io->y + y, x - start, 1);
+    for (int i = start; i < x; i++) {
+      stream_pixel(self, &run, pixels[i]);
+    }
+    stream_end(self, &run);
+  }
+}
+
+static void png_raise(int result) {
+  switch (result) {
+  case PNG_ERR_READ:
+    mp_raise_ValueError(MP_ERROR_TEXT("png data ended early"));
+  case PNG_ERR_UNSUPPORTED:
+    mp_raise_ValueError(MP_ERROR_TEXT("unsupported png format"));
+  case PNG_ERR_FORMAT:
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid png data"));
+  }
+}
+
+static mp_obj_t st7789_ST7789_png(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_int_t x = mp_obj_get_int(args[2]);
+  mp_int_t y = mp_obj_get_int(args[3]);
+
+  // parsed before the file is opened, so a bad value can't leave it open
+  mp_int_t bg = (n_args > 4 && args[4] != mp_const_none)
+                    ? mp_obj_get_int(args[4]) & 0xFFFF
+                    : -1;
+
+  st7789_image_io_t io;
+  image_open(self, &io, args[1], x, y);
+  io.bg = bg;
+
+  // volatile, the handler reads them after a raise
+  png_t *volatile png = NULL;
+  uint8_t *volatile work = NULL;
+  int result;
+  nlr_buf_t nlr;
+  if (nlr_push(&nlr) == 0) {
+    png = m_new(png_t, 1);
+    result = png_open(png, image_read, &io);
+    if (result == PNG_OK) {
+      work = m_new(uint8_t, png->work_size);
+      bool keyed = png->has_alpha && io.bg < 0;
+      if (!keyed) {
+        stream_begin(self, &io.stream, x, y, png->width, png->height);
+      }
+      result = png_decode(png, work, image_write_row, &io);
+      if (!keyed) {
+        stream_end(self, &io.stream);
+      }
+    }
+    nlr_pop();
+  } else {
+    // out of memory or a write raised, don't leave the file open
+    if (work) {
+      m_del(uint8_t, work, png->work_size);
+    }
+    if (png) {
+      m_del(png_t, png, 1);
+    }
+    image_close_file(&io, args[1]);
+    nlr_jump(nlr.ret_val);
+  }
+  if (work) {
+    m_del(uint8_t, work, png->work_size);
+  }
+  m_del(png_t, png, 1);
+
+  image_close(&io, args[1]);
+  png_raise(result);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_png_obj, 4, 5,
+                                           st7789_ST7789_png);
+
+// copy RGB565 data into the frame buffer, clipping to the display
+static void blit_frame_buffer(st7789_ST7789_obj_t *self, const uint8_t *buf,
+                              size_t len, int x, int y, int w, int h) {
+  int x0 = MAX(x, 0);
+  int y0 = MAX(y, 0);
+  int x1 = MIN(x + w - 1, self->width - 1);
+  int y1 = MIN(y + h - 1, self->height - 1);
+
+  if (x0 > x1 || y0 > y1) {
+    return;
+  }
+
+  frame_buffer_wait(self);
+  size_t row_len = (x1 - x0 + 1) * 2;
+  for (int row = y0; row <= y1; row++) {
+    size_t offset = ((row - y) * w + (x0 - x)) * 2;
+    if (offset + row_len > len) {
+      break;
+    }
+    memcpy(&self->frame_buffer[row * self->width + x0], buf + offset, row_len);
+  }
+  mark_dirty(self, x0, y0, x1, y1);
+}
+
+// display memory position written at address ca, ra with madctl
+static void gram_position(uint8_t madctl, int ca, int ra, int *u, int *v) {
+  *u = (madctl & ST7789_MADCTL_MV) ? ra : ca;
+  *v = (madctl & ST7789_MADCTL_MV) ? ca : ra;
+  if (madctl & ST7789_MADCTL_MX) {
+    *u = GRAM_COLS - 1 - *u;
+  }
+  if (madctl & ST7789_MADCTL_MY) {
+    *v = GRAM_ROWS - 1 - *v;
+  }
+}
+
+// the address written at display memory position u, v with madctl
+static void gram_address(uint8_t madctl, int u, int v, int *ca, int *ra) {
+  if (madctl & ST7789_MADCTL_MX) {
+    u = GRAM_COLS - 1 - u;
+  }
+  if (madctl & ST7789_MADCTL_MY) {
+    v = GRAM_ROWS - 1 - v;
+  }
+  *ca = (madctl & ST7789_MADCTL_MV) ? v : u;
+  *ra = (madctl & ST7789_MADCTL_MV) ? u : v;
+}
+
+// position of pixel sx, sy of a w by h image in the transformed image
+static void transform_point(int transform, int w, int h, int sx, int sy,
+                            int *x, int *y) {
+  if (transform & TRANSFORM_FLIP_X) {
+    sx = w - 1 - sx;
+  }
+  if (transform & TRANSFORM_FLIP_Y) {
+    sy = h - 1 - sy;
+  }
+  *x = (transform & TRANSFORM_ROT90) ? sy : sx;
+  *y = (transform & TRANSFORM_ROT90) ? w - 1 - sx : sy;
+}
+
+// The display writes the pixels of a window in address order, so any
+// rotation or mirroring of an image is a different MADCTL address order:
+// find the one that sends the image rows unchanged to the transformed
+// position and restore the rotation afterwards. Images that are clipped, or
+// drawn through the frame buffer or the scroll area are transformed while
+// streaming instead.
+static void blit_transformed(st7789_ST7789_obj_t *self, const uint8_t *buf,
+                             int x, int y, int w, int h, int transform) {
+  int tw = (transform & TRANSFORM_ROT90) ? h : w;
+  int th = (transform & TRANSFORM_ROT90) ? w : h;
+
+  if (self->frame_buffer || self->scroll.active || x < 0 || y < 0 ||
+      x + tw > self->width || y + th > self->height) {
+    st7789_stream_t stream;
+    stream_begin(self, &stream, x, y, tw, th);
+    for (int ty = 0; ty < th && !stream_done(&stream); ty++) {
+      for (int tx = 0; tx < tw; tx++) {
+        // the inverse of transform_point()
+        int sx = (transform & TRANSFORM_ROT90) ? w - 1 - ty : tx;
+        int sy = (transform & TRANSFORM_ROT90) ? tx : ty;
+        if (transform & TRANSFORM_FLIP_X) {
+          sx = w - 1 - sx;
+        }
+        if (transform & TRANSFORM_FLIP_Y) {
+          sy = h - 1 - sy;
+        }
+        const uint8_t *p = buf + (sy * w + sx) * 2;
+        stream_pixel(self, &stream, (p[0] << 8) | p[1]);
+      }
+    }
+    stream_end(self, &stream);
+    return;
+  }
+
+  // display memory positions of the first pixel and its neighbours
+  int u[3], v[3];
+  static const int8_t step[3][2] = {{0, 0}, {1, 0}, {0, 1}};
+  for (int i = 0; i < 3; i++) {
+    int tx, ty;
+    transform_point(transform, w, h, step[i][0], step[i][1], &tx, &ty);
+    gram_position(self->madctl, x + tx + self->colstart,
+                  y + ty + self->rowstart, &u[i], &v[i]);
+  }
+
+  // try the eight combinations of MV, MX and MY, bits 5 to 7 of MADCTL
+  uint8_t madctl = self->madctl;
+  int col = 0, row = 0;
+  for (int order = 0; order < 8; order++) {
+    madctl = (self->madctl & ~(ST7789_MADCTL_MY | ST7789_MADCTL_MX |
+                               ST7789_MADCTL_MV)) |
+             (order << 5);
+    int ca[3], ra[3];
+    for (int i = 0; i < 3; i++) {
+      gram_address(madctl, u[i], v[i], &ca[i], &ra[i]);
+    }
+    if (ca[1] == ca[0] + 1 && ra[1] == ra[0] && ca[2] == ca[0] &&
+        ra[2] == ra[0] + 1) {
+      col = ca[0];
+      row = ra[0];
+      break;
+    }
+  }
+
+  if (self->bounding) {
+    mark_dirty(self, x, y, x + tw - 1, y + th - 1);
+  }
+  write_cmd(self, ST7789_MADCTL, &madctl, 1);
+  self->window.segments = 1;
+  send_address(self, col, row, col + w - 1, row + h - 1);
+  if (is_12bit(self)) {
+    write_rows_12bit(self, buf, w * h, 0, 1);
+  } else {
+    STATS_ADD(pixels_blitted, w * h);
+    DC_HIGH();
+    CS_LOW();
+    for (size_t i = 0, len = w * h * 2; i < len; i += self->buffer_size) {
+      write_data(self, buf + i, MIN(len - i, self->buffer_size));
+    }
+    CS_HIGH();
+  }
+  write_cmd(self, ST7789_MADCTL, &self->madctl, 1);
+}
+
+static mp_obj_t st7789_ST7789_blit_buffer(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  mp_buffer_info_t buf_info;
+  mp_get_buffer_raise(args[1], &buf_info, MP_BUFFER_READ);
+  mp_int_t x = mp_obj_get_int(args[2]);
+  mp_int_t y = mp_obj_get_int(args[3]);
+  mp_int_t w = mp_obj_get_int(args[4]);
+  mp_int_t h = mp_obj_get_int(args[5]);
+  mp_int_t transform = (n_args > 6) ? mp_obj_get_int(args[6]) : 0;
+
+  if (transform & ~(TRANSFORM_ROT90 | TRANSFORM_ROT180)) {
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid transform"));
+  }
+  if (transform) {
+    if (w <= 0 || h <= 0) {
+      return mp_const_none;
+    }
+    if (w > 0x7FFF || h > 0x7FFF) {
+      mp_raise_ValueError(MP_ERROR_TEXT("image too large"));
+    }
+    if (buf_info.len < (size_t)w * h * 2) {
+      mp_raise_ValueError(MP_ERROR_TEXT("buffer too small"));
+    }
+    blit_transformed(self, (const uint8_t *)buf_info.buf, x, y, w, h,
+                     transform);
+    return mp_const_none;
+  }
+
+  if (self->frame_buffer) {
+    blit_frame_buffer(self, (const uint8_t *)buf_info.buf, buf_info.len, x, y,
+                      w, h);
+    return mp_const_none;
+  }
+
+  set_window(self, x, y, x + w - 1, y + h - 1);
+  int limit = MIN(buf_info.len, w * h * 2);
+  if (is_12bit(self)) {
+    write_rows_12bit(self, (const uint8_t *)buf_info.buf, limit / 2, 0, 1);
+    return mp_const_none;
+  }
+  STATS_ADD(pixels_blitted, limit / 2);
+  if (self->options & OPTIONS_ASYNC) {
+    async_start(self, args[1], (const uint8_t *)buf_info.buf, limit, limit, 1);
+    return mp_const_none;
+  }
+
+  DC_HIGH();
+  CS_LOW();
+
+  const int buf_size = self->buffer_size;
+  int chunks = limit / buf_size;
+  int rest = limit % buf_size;
+  int i = 0;
+  for (; i < chunks; i++) {
+    write_data(self, (const uint8_t *)buf_info.buf + i * buf_size, buf_size);
+  }
+  if (rest) {
+    write_data(self, (const uint8_t *)buf_info.buf + i * buf_size, rest);
+  }
+  CS_HIGH();
+
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_blit_buffer_obj, 6, 7,
+                                           st7789_ST7789_blit_buffer);
+
+//
+// Sprites
+//
+// Sprites are RGB565 bitmaps with an optional transparent color, composited
+// over the frame buffer when there is one, or over sprite_bg otherwise,
+// without changing the frame buffer. update_sprites() redraws only the areas
+// sprites left or moved to, merged where they overlap, composing them a row
+// at a time in the transfer buffer.
+//
+
+typedef struct _sprite_rect_t {
+  int x0, y0, x1, y1;
+} sprite_rect_t;
+
+static st7789_sprite_t *sprite_arg(st7789_ST7789_obj_t *self, mp_obj_t id) {
+  mp_int_t index = mp_obj_get_int(id);
+  if (index < 0 || index >= MAX_SPRITES) {
+    mp_raise_ValueError(MP_ERROR_TEXT("sprite id out of range"));
+  }
+  if (self->sprites == NULL) {
+    self->sprites = m_new0(st7789_sprite_t, MAX_SPRITES);
+  }
+  return &self->sprites[index];
+}
+
+// visible sprites bottom first, returns how many
+static size_t sprite_order(st7789_ST7789_obj_t *self, uint8_t *order) {
+  size_t count = 0;
+  for (size_t i = 0; self->sprites && i < MAX_SPRITES; i++) {
+    const st7789_sprite_t *sprite = &self->sprites[i];
+    if (sprite->data_obj == MP_OBJ_NULL || !sprite->visible) {
+      continue;
+    }
+    size_t j = count++;
+    while (j > 0 && self->sprites[order[j - 1]].z > sprite->z) {
+      order[j] = order[j - 1];
+      j--;
+    }
+    order[j] = i;
+  }
+  return count;
+}
+
+// compose n pixels of row y starting at x, byte swapped
+static void sprite_span(st7789_ST7789_obj_t *self, uint16_t *dst, int x, int y,
+                        int n, const uint8_t *order, size_t count) {
+  if (self->frame_buffer) {
+    memcpy(dst, &self->frame_buffer[y * self->width + x], n * 2);
+  } else {
+    uint16_t bg = _swap_bytes(self->sprite_bg);
+    for (int i = 0; i < n; i++) {
+      dst[i] = bg;
+    }
+  }
+
+  for (size_t k = 0; k < count; k++) {
+    const st7789_sprite_t *sprite = &self->sprites[order[k]];
+    if (y < sprite->y || y >= sprite->y + sprite->height) {
+      continue;
+    }
+    int x0 = MAX(x, sprite->x);
+    int x1 = MIN(x + n, sprite->x + sprite->width);
+    if (x0 >= x1) {
+      continue;
+    }
+    const uint8_t *src =
+        sprite->data +
+        ((size_t)(y - sprite->y) * sprite->width + (x0 - sprite->x)) * 2;
+    uint16_t *out = dst + (x0 - x);
+    if (sprite->key < 0) {
+      memcpy(out, src, (x1 - x0) * 2);
+      continue;
+    }
+    for (int i = 0; i < x1 - x0; i++, src += 2) {
+      uint16_t pixel;
+      memcpy(&pixel, src, 2);
+      if (pixel != sprite->key) {
+        out[i] = pixel;
+      }
+    }
+  }
+}
+
+// compose an area of the display and send it
+static void sprite_render(st7789_ST7789_obj_t *self, int x0, int y0, int x1,
+                          int y1, const uint8_t *order, size_t count) {
+  set_window(self, x0, y0, x1, y1);
+  size_t capacity = buffer_pixels(self);
+  size_t width = x1 - x0 + 1;
+  size_t len = 0;
+  for (int y = y0; y <= y1; y++) {
+    for (size_t done = 0; done < width;) {
+      size_t n = MIN(width - done, capacity - len);
+      sprite_span(self, &self->buffer[len], x0 + done, y, n, order, count);
+      len += n;
+      done += n;
+      if (len == capacity) {
+        write_buffer(self, len);
+        len = 0;
+      }
+    }
+  }
+  if (len) {
+    write_buffer(self, len);
+  }
+}
+
+static void sprite_add_rect(st7789_ST7789_obj_t *self, sprite_rect_t *rects,
+                            size_t *count, int x, int y, int w, int h) {
+  sprite_rect_t rect = {MAX(x, 0), MAX(y, 0), MIN(x + w - 1, self->width - 1),
+                        MIN(y + h - 1, self->height - 1)};
+  if (rect.x0 <= rect.x1 && rect.y0 <= rect.y1) {
+    rects[(*count)++] = rect;
+  }
+}
+
+// merge overlapping rectangles so no area is sent twice
+static size_t sprite_merge_rects(sprite_rect_t *rects, size_t count) {
+  bool merged;
+  do {
+    merged = false;
+    for (size_t i = 0; i < count; i++) {
+      for (size_t j = i + 1; j < count; j++) {
+        sprite_rect_t *a = &rects[i], *b = &rects[j];
+        if (a->x0 > b->x1 || b->x0 > a->x1 || a->y0 > b->y1 || b->y0 > a->y1) {
+          continue;
+        }
+        a->x0 = MIN(a->x0, b->x0);
+        a->y0 = MIN(a->y0, b->y0);
+        a->x1 = MAX(a->x1, b->x1);
+        a->y1 = MAX(a->y1, b->y1);
+        *b = rects[--count];
+        merged = true;
+        j--;
+      }
+    }
+  } while (merged);
+  return count;
+}
+
+// redraw the areas of the sprites that changed since the last update
+static void update_sprites(st7789_ST7789_obj_t *self) {
+  if (self->sprites == NULL) {
+    return;
+  }
+
+  sprite_rect_t rects[MAX_SPRITES * 2];
+  size_t count = 0;
+  for (size_t i = 0; i < MAX_SPRITES; i++) {
+    st7789_sprite_t *sprite = &self->sprites[i];
+    if (!sprite->changed) {
+      continue;
+    }
+    if (sprite->drawn) {
+      sprite_add_rect(self, rects, &count, sprite->drawn_x, sprite->drawn_y,
+                      sprite->drawn_width, sprite->drawn_height);
+    }
+    sprite->drawn = sprite->visible && sprite->data_obj != MP_OBJ_NULL;
+    if (sprite->drawn) {
+      sprite_add_rect(self, rects, &count, sprite->x, sprite->y,
+                      sprite->width, sprite->height);
+    }
+    sprite->drawn_x = sprite->x;
+    sprite->drawn_y = sprite->y;
+    sprite->drawn_width = sprite->width;
+    sprite->drawn_height = sprite->height;
+    sprite->changed = false;
+  }
+  if (count == 0) {
+    return;
+  }
+  count = sprite_merge_rects(rects, count);
+
+  uint8_t order[MAX_SPRITES];
+  size_t visible = sprite_order(self, order);
+  for (size_t i = 0; i < count; i++) {
+    sprite_render(self, rects[i].x0, rects[i].y0, rects[i].x1, rects[i].y1,
+                  order, visible);
+  }
+}
+
+static mp_obj_t st7789_ST7789_sprite(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  st7789_sprite_t *sprite = sprite_arg(self, args[1]);
+
+  if (args[2] == mp_const_none) {
+    sprite->data_obj = MP_OBJ_NULL;
+    sprite->data = NULL;
+    sprite->changed = true;
+    return mp_const_none;
+  }
+  if (n_args < 5) {
+    mp_raise_ValueError(MP_ERROR_TEXT("sprite needs width and height"));
+  }
+
+  mp_buffer_info_t buf_info;
+  mp_get_buffer_raise(args[2], &buf_info, MP_BUFFER_READ);
+  mp_int_t w = mp_obj_get_int(args[3]);
+  mp_int_t h = mp_obj_get_int(args[4]);
+  if (w <= 0 || h <= 0 || w > 0xFFFF || h > 0xFFFF ||
+      buf_info.len < (size_t)w * h * 2) {
+    mp_raise_ValueError(MP_ERROR_TEXT("sprite buffer too small"));
+  }
+
+  sprite->data_obj = args[2];
+  sprite->data = buf_info.buf;
+  sprite->width = w;
+  sprite->height = h;
+  sprite->key = (n_args > 5 && args[5] != mp_const_none)
+                    ? _swap_bytes(mp_obj_get_int(args[5]) & 0xFFFF)
+                    : -1;
+  sprite->changed = true;
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_sprite_obj, 3, 6,
+                                           st7789_ST7789_sprite);
+
+static mp_obj_t st7789_ST7789_move_sprite(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  st7789_sprite_t *sprite = sprite_arg(self, args[1]);
+  mp_int_t x = mp_obj_get_int(args[2]);
+  mp_int_t y = mp_obj_get_int(args[3]);
+  mp_int_t z = (n_args > 4) ? mp_obj_get_int(args[4]) : sprite->z;
+  // checked before comparing, a stored value that wrapped would never match
+  if (x < INT16_MIN || x > INT16_MAX || y < INT16_MIN || y > INT16_MAX) {
+    mp_raise_ValueError(MP_ERROR_TEXT("sprite position out of range"));
+  }
+  if (z < INT8_MIN || z > INT8_MAX) {
+    mp_raise_ValueError(MP_ERROR_TEXT("sprite z out of range"));
+  }
+
+  if (x != sprite->x || y != sprite->y || z != sprite->z || !sprite->visible) {
+    sprite->x = x;
+    sprite->y = y;
+    sprite->z = z;
+    sprite->visible = true;
+    sprite->changed = true;
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_move_sprite_obj, 4, 5,
+                                           st7789_ST7789_move_sprite);
+
+static mp_obj_t st7789_ST7789_hide_sprite(mp_obj_t self_in, mp_obj_t id) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  st7789_sprite_t *sprite = sprite_arg(self, id);
+
+  if (sprite->visible) {
+    sprite->visible = false;
+    sprite->changed = true;
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(st7789_ST7789_hide_sprite_obj,
+                                 st7789_ST7789_hide_sprite);
+
+static mp_obj_t st7789_ST7789_sprite_background(mp_obj_t self_in,
+                                                mp_obj_t color) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  self->sprite_bg = mp_obj_get_int(color);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(st7789_ST7789_sprite_background_obj,
+                                 st7789_ST7789_sprite_background);
+
+static mp_obj_t st7789_ST7789_update_sprites(mp_obj_t self_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  update_sprites(self);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(st7789_ST7789_update_sprites_obj,
+                                 st7789_ST7789_update_sprites);
+
+// push a frame buffer region to the display
+static void show_window(st7789_ST7789_obj_t *self, uint16_t x0, uint16_t y0,
+                        uint16_t x1, uint16_t y1) {
+  set_window(self, x0, y0, x1, y1);
+  if (is_12bit(self)) {
+    write_rows_12bit(
+        self, (const uint8_t *)&self->frame_buffer[y0 * self->width + x0],
+        x1 - x0 + 1, self->width * 2, y1 - y0 + 1);
+    return;
+  }
+  STATS_ADD(pixels_blitted, (x1 - x0 + 1) * (y1 - y0 + 1));
+  if (self->options & OPTIONS_ASYNC) {
+    // frame buffer writes wait for these rows, see frame_buffer_wait()
+    async_start(self, MP_OBJ_NULL,
+                (const uint8_t *)&self->frame_buffer[y0 * self->width + x0],
+                (x1 - x0 + 1) * 2, self->width * 2, y1 - y0 + 1);
+    return;
+  }
+  DC_HIGH();
+  CS_LOW();
+  if (x0 == 0 && x1 == self->width - 1) {
+    // full width rows are contiguous in the buffer, send them in one go
+    write_data(self, (const uint8_t *)&self->frame_buffer[y0 * self->width],
+               (y1 - y0 + 1) * self->width * 2);
+  } else {
+    for (int y = y0; y <= y1; y++) {
+      write_data(self,
+                 (const uint8_t *)&self->frame_buffer[y * self->width + x0],
+                 (x1 - x0 + 1) * 2);
+    }
+  }
+  CS_HIGH();
+}
+
+// push the dirty tiles of the frame buffer to the display with any sprites
+// composited over them, then update the sprites
+static void show(st7789_ST7789_obj_t *self) {
+  uint8_t order[MAX_SPRITES];
+  size_t sprites = sprite_order(self, order);
+  uint16_t x0, y0, x1, y1;
+  while (next_dirty_rect(self, self->dirty, &x0, &y0, &x1, &y1)) {
+    if (sprites) {
+      sprite_render(self, x0, y0, x1, y1, order, sprites);
+    } else {
+      show_window(self, x0, y0, x1, y1);
+    }
+  }
+  clear_dirty(self);
+  update_sprites(self);
+}
+
+static mp_obj_t st7789_ST7789_show(mp_obj_t self_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+  if (self->frame_buffer == NULL) {
+    mp_raise_msg(&mp_type_RuntimeError,
+                 MP_ERROR_TEXT("framebuffer mode not enabled"));
+  }
+  show(self);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(st7789_ST7789_show_obj, st7789_ST7789_show);
+
+static mp_obj_t st7789_ST7789_busy(mp_obj_t self_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+  // retry if the scheduler queue was full when the last step finished
+  async_schedule(self);
+  return mp_obj_new_bool(self->job.rows != 0);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(st7789_ST7789_busy_obj, st7789_ST7789_busy);
+
+static mp_obj_t st7789_ST7789_wait(mp_obj_t self_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  async_wait(self);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(st7789_ST7789_wait_obj, st7789_ST7789_wait);
+
+static mp_obj_t st7789_ST7789_dirty_rects(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  bool clear = (n_args > 1) ? mp_obj_is_true(args[1]) : false;
+
+  // walk a copy of the map unless the caller wants it cleared anyway
+  uint32_t *map = self->dirty;
+  if (!clear) {
+    map = m_new(uint32_t, self->dirty_rows);
+    memcpy(map, self->dirty, self->dirty_rows * sizeof(uint32_t));
+  }
+
+  mp_obj_t rects = mp_obj_new_list(0, NULL);
+  uint16_t x0, y0, x1, y1;
+  while (next_dirty_rect(self, map, &x0, &y0, &x1, &y1)) {
+    mp_obj_t rect[4] = {mp_obj_new_int(x0), mp_obj_new_int(y0),
+                        mp_obj_new_int(x1 - x0 + 1),
+                        mp_obj_new_int(y1 - y0 + 1)};
+    mp_obj_list_append(rects, mp_obj_new_tuple(4, rect));
+  }
+
+  if (clear) {
+    clear_dirty(self);
+  } else {
+    m_del(uint32_t, map, self->dirty_rows);
+  }
+  return rects;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_dirty_rects_obj, 1, 2,
+                                           st7789_ST7789_dirty_rects);
+
+//
+// Scroll area
+//
+// scroll_area() fixes rows at the top and bottom of the display and scroll()
+// moves the rows between them with VSCSAD. Drawing keeps using the rows as
+// seen on the display: set_address() translates them through the scroll
+// offset and splits windows that cross the wrap. VSCRDEF and VSCSAD count
+// display memory rows, which run upwards on the display when MY is set, and
+// only run along logical rows when MV is clear.
+//
+
+static void scroll_send(st7789_ST7789_obj_t *self) {
+  st7789_scroll_t *scroll = &self->scroll;
+  int tfa = 0, vsa = GRAM_ROWS, vsp = 0;
+  if (scroll->active) {
+    int above = self->rowstart + scroll->top;
+    int below = GRAM_ROWS - above - scroll->rows;
+    vsa = scroll->rows;
+    if (self->madctl & ST7789_MADCTL_MY) {
+      tfa = below;
+      vsp = tfa + (vsa - scroll->offset) % vsa;
+    } else {
+      tfa = above;
+      vsp = tfa + scroll->offset;
+    }
+  }
+  int bfa = GRAM_ROWS - tfa - vsa;
+  uint8_t area[6] = {tfa >> 8, tfa & 0xFF, vsa >> 8,
+                     vsa & 0xFF, bfa >> 8, bfa & 0xFF};
+  write_cmd(self, ST7789_VSCRDEF, area, 6);
+  uint8_t start[2] = {vsp >> 8, vsp & 0xFF};
+  write_cmd(self, ST7789_VSCSAD, start, 2);
+}
+
+// turn the scroll area off after a rotation
+static void scroll_reset(st7789_ST7789_obj_t *self) {
+  if (self->scroll.active) {
+    self->scroll.active = false;
+    scroll_send(self);
+  }
+}
+
+static void reverse_rows(st7789_ST7789_obj_t *self, int first, int count) {
+  frame_buffer_wait(self);
+  for (int i = first, j = first + count - 1; i < j; i++, j--) {
+    uint16_t *a = &self->frame_buffer[i * self->width];
+    uint16_t *b = &self->frame_buffer[j * self->width];
+    for (int x = 0; x < self->width; x++) {
+      uint16_t t = a[x];
+      a[x] = b[x];
+      b[x] = t;
+    }
+  }
+}
+
+// scroll the rows between top and bottom, starting at offset 0
+static void scroll_set(st7789_ST7789_obj_t *self, int top, int bottom) {
+  st7789_scroll_t *scroll = &self->scroll;
+  if (self->madctl & ST7789_MADCTL_MV) {
+    mp_raise_ValueError(MP_ERROR_TEXT("scrolling needs a portrait rotation"));
+  }
+  if (is_12bit(self)) {
+    mp_raise_ValueError(MP_ERROR_TEXT("scrolling needs COLOR_MODE_16BIT"));
+  }
+  if (top < 0 || bottom < 0 || top + bottom >= self->height) {
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid scroll area"));
+  }
+  scroll->active = true;
+  scroll->top = top;
+  scroll->bottom = bottom;
+  scroll->rows = self->height - top - bottom;
+  scroll->offset = 0;
+  scroll_send(self);
+
+  // the display now shows display memory in a different order
+  if (self->frame_buffer) {
+    mark_dirty(self, 0, 0, self->width - 1, self->height - 1);
+  }
+}
+
+// scroll the content up n rows, 0 < n < rows
+static void scroll_rows(st7789_ST7789_obj_t *self, int n) {
+  st7789_scroll_t *scroll = &self->scroll;
+  if (self->frame_buffer) {
+    // send pending changes while the dirty tiles still match the display,
+    // then move the frame buffer rows the same way as the display
+    show(self);
+    reverse_rows(self, scroll->top, n);
+    reverse_rows(self, scroll->top + n, scroll->rows - n);
+    reverse_rows(self, scroll->top, scroll->rows);
+  }
+
+  scroll->offset = (scroll->offset + n) % scroll->rows;
+  scroll_send(self);
+}
+
+static mp_obj_t st7789_ST7789_scroll_area(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+
+  if (n_args == 1) {
+    scroll_reset(self);
+    if (self->frame_buffer) {
+      mark_dirty(self, 0, 0, self->width - 1, self->height - 1);
+    }
+  } else {
+    mp_int_t top = mp_obj_get_int(args[1]);
+    mp_int_t bottom = (n_args > 2) ? mp_obj_get_int(args[2]) : 0;
+    scroll_set(self, top, bottom);
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_scroll_area_obj, 1, 3,
+                                           st7789_ST7789_scroll_area);
+
+static mp_obj_t st7789_ST7789_scroll(mp_obj_t self_in, mp_obj_t rows_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  st7789_scroll_t *scroll = &self->scroll;
+
+  if (!scroll->active) {
+    mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("no scroll area set"));
+  }
+  int n = mod(mp_obj_get_int(rows_in), scroll->rows);
+  if (n != 0) {
+    scroll_rows(self, n);
+  }
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_2(st7789_ST7789_scroll_obj,
+                                 st7789_ST7789_scroll);
+
+//
+// Console
+//
+// console() keeps a grid of character cells for the whole text lines that fit
+// in the scroll area. Writing only updates the cells, the changed cells of a
+// line are drawn through one window when the cursor leaves the line or
+// console_write() returns. A new line at the bottom scrolls the console up
+// one text line with VSCSAD and draws just the new line.
+//
 
-      if (h > 0) {
-        int16_t y2 = y + h - 1;
-        set_window(self, x, y, x, y2);
-        DC_HIGH();
-        CS_LOW();
-        fill_color_buffer(self->spi_obj, color, h);
-        CS_HIGH();
+// colors of SGR 30-37 and 90-97
+static const uint16_t console_ansi[16] = {
+    0x0000, 0xA800, 0x0540, 0xAAA0, 0x0015, 0xA815, 0x0555, 0xAD55,
+    0x52AA, 0xFAAA, 0x57EA, 0xFFEA, 0x52BF, 0xFABF, 0x57FF, 0xFFFF};
+
+// escape sequence parser states
+#define CONSOLE_TEXT 0
+#define CONSOLE_ESC 1
+#define CONSOLE_CSI 2
+
+static st7789_cell_t *console_line(st7789_console_t *con, int row) {
+  return &con->cells[((con->first + row) % con->rows) * con->cols];
+}
+
+// draw cells start..end - 1 of a line, characters missing from the font are
+// drawn blank
+static void console_draw(st7789_ST7789_obj_t *self, int row, int start,
+                         int end) {
+  st7789_console_t *con = self->console;
+  const st7789_bitmap_font_t *font = &con->font;
+  const st7789_cell_t *line = console_line(con, row);
+
+  st7789_stream_t stream;
+  stream_begin(self, &stream, start * font->width,
+               con->top + row * font->height, (end - start) * font->width,
+               font->height);
+  for (int y = 0; y < font->height && !stream_done(&stream); y++) {
+    for (int i = start; i < end; i++) {
+      uint16_t fg = con->colors[line[i].fg];
+      uint16_t bg = con->colors[line[i].bg];
+      if (!bitmap_font_has(font, line[i].c)) {
+        stream_run(self, &stream, bg, font->width);
+        continue;
+      }
+      const uint8_t *bits = font->glyphs +
+                            (line[i].c - font->first) * font->glyph_size +
+                            y * font->row_bytes;
+      for (int col = 0; col < font->width; col++) {
+        stream_pixel(self, &stream,
+                     (bits[col >> 3] & (0x80 >> (col & 7))) ? fg : bg);
       }
     }
+  }
+  stream_end(self, &stream);
+}
+
+static void console_flush(st7789_ST7789_obj_t *self) {
+  st7789_console_t *con = self->console;
+  if (con->dirty_end > con->dirty_start) {
+    console_draw(self, con->dirty_row, con->dirty_start, con->dirty_end);
+    con->dirty_end = con->dirty_start;
+  }
+}
+
+// note cells start..end - 1 of a line need drawing
+static void console_touch(st7789_ST7789_obj_t *self, int row, int start,
+                          int end) {
+  st7789_console_t *con = self->console;
+  if (con->dirty_end > con->dirty_start && con->dirty_row != row) {
+    console_flush(self);
+  }
+  if (con->dirty_end > con->dirty_start) {
+    con->dirty_start = MIN(con->dirty_start, start);
+    con->dirty_end = MAX(con->dirty_end, end);
   } else {
-    for (int d = 0; d < h; d++) {
-      draw_pixel(self, x, y + d, color);
-    }
+    con->dirty_row = row;
+    con->dirty_start = start;
+    con->dirty_end = end;
   }
 }
 
-static mp_obj_t st7789_ST7789_vline(size_t n_args, const mp_obj_t *args) {
-  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
-  mp_int_t x = mp_obj_get_int(args[1]);
-  mp_int_t y = mp_obj_get_int(args[2]);
-  mp_int_t w = mp_obj_get_int(args[3]);
-  mp_int_t color = mp_obj_get_int(args[4]);
+static void console_erase(st7789_ST7789_obj_t *self, int row, int start,
+                          int end) {
+  st7789_console_t *con = self->console;
+  st7789_cell_t *line = console_line(con, row);
+  for (int i = start; i < end; i++) {
+    line[i].c = ' ';
+    line[i].fg = con->fg;
+    line[i].bg = con->bg;
+  }
+  if (start < end) {
+    console_touch(self, row, start, end);
+  }
+}
 
-  fast_vline(self, x, y, w, color);
-  return mp_const_none;
+static void console_clear(st7789_ST7789_obj_t *self) {
+  st7789_console_t *con = self->console;
+  for (int row = 0; row < con->rows; row++) {
+    console_erase(self, row, 0, con->cols);
+  }
+  // one fill instead of drawing every line
+  con->dirty_end = con->dirty_start;
+  fill_rect(self, 0, con->top, self->width, con->rows * con->font.height,
+            con->colors[con->bg]);
 }
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_vline_obj, 5, 5,
-                                           st7789_ST7789_vline);
 
-static mp_obj_t st7789_ST7789_rect(size_t n_args, const mp_obj_t *args) {
-  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
-  mp_int_t x = mp_obj_get_int(args[1]);
-  mp_int_t y = mp_obj_get_int(args[2]);
-  mp_int_t w = mp_obj_get_int(args[3]);
-  mp_int_t h = mp_obj_get_int(args[4]);
-  mp_int_t color = mp_obj_get_int(args[5]);
+// scroll up a line to bring the cursor back from below the last line
+static void console_scroll(st7789_ST7789_obj_t *self) {
+  st7789_console_t *con = self->console;
+  console_flush(self);
+  scroll_rows(self, con->font.height);
+  con->first = (con->first + 1) % con->rows;
+  con->row = con->rows - 1;
+  console_erase(self, con->row, 0, con->cols);
+}
 
-  fast_hline(self, x, y, w, color);
-  fast_vline(self, x, y, h, color);
-  fast_hline(self, x, y + h - 1, w, color);
-  fast_vline(self, x + w - 1, y, h, color);
-  return mp_const_none;
+// a new line after the last leaves the cursor below it, scrolling waits for
+// the next character so the new line is drawn once with its text
+static void console_newline(st7789_ST7789_obj_t *self) {
+  st7789_console_t *con = self->console;
+  if (con->row == con->rows) {
+    console_scroll(self);
+  }
+  con->col = 0;
+  con->row++;
 }
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_rect_obj, 6, 6,
-                                           st7789_ST7789_rect);
 
-static mp_obj_t st7789_ST7789_fill_rect(size_t n_args, const mp_obj_t *args) {
-  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
-  mp_int_t x = mp_obj_get_int(args[1]);
-  mp_int_t y = mp_obj_get_int(args[2]);
-  mp_int_t w = mp_obj_get_int(args[3]);
-  mp_int_t h = mp_obj_get_int(args[4]);
-  mp_int_t color = mp_obj_get_int(args[5]);
+static void console_char(st7789_ST7789_obj_t *self, uint8_t c) {
+  st7789_console_t *con = self->console;
+  if (con->col == con->cols) {
+    console_newline(self);
+  }
+  if (con->row == con->rows) {
+    console_scroll(self);
+  }
+  st7789_cell_t *cell = &console_line(con, con->row)[con->col];
+  cell->c = c;
+  cell->fg = (con->bold && con->fg < 8) ? con->fg + 8 : con->fg;
+  cell->bg = con->bg;
+  console_touch(self, con->row, con->col, con->col + 1);
+  con->col++;
+}
+
+// select graphic rendition, colors and bold only
+static void console_sgr(st7789_console_t *con, int p) {
+  if (p == 0) {
+    con->fg = CONSOLE_FG;
+    con->bg = CONSOLE_BG;
+    con->bold = false;
+  } else if (p == 1) {
+    con->bold = true;
+  } else if (p == 22) {
+    con->bold = false;
+  } else if (p >= 30 && p <= 37) {
+    con->fg = p - 30;
+  } else if (p == 39) {
+    con->fg = CONSOLE_FG;
+  } else if (p >= 40 && p <= 47) {
+    con->bg = p - 40;
+  } else if (p == 49) {
+    con->bg = CONSOLE_BG;
+  } else if (p >= 90 && p <= 97) {
+    con->fg = p - 90 + 8;
+  } else if (p >= 100 && p <= 107) {
+    con->bg = p - 100 + 8;
+  }
+}
 
-  uint16_t right = x + w - 1;
-  uint16_t bottom = y + h - 1;
+// the final character of a control sequence, other sequences are ignored
+static void console_csi(st7789_ST7789_obj_t *self, uint8_t c) {
+  st7789_console_t *con = self->console;
+  int p0 = con->nparams > 0 ? con->params[0] : 0;
+  int p1 = con->nparams > 1 ? con->params[1] : 0;
 
-  if (x < self->width && y < self->height) {
-    if (right > self->width) {
-      right = self->width;
+  switch (c) {
+  case 'm':
+    if (con->nparams == 0) {
+      console_sgr(con, 0);
+    }
+    for (int i = 0; i < con->nparams; i++) {
+      console_sgr(con, con->params[i]);
     }
+    break;
 
-    if (bottom > self->height) {
-      bottom = self->height;
+  case 'H': // cursor position, 1 based
+    con->row = MIN(MAX(p0, 1), con->rows) - 1;
+    con->col = MIN(MAX(p1, 1), con->cols) - 1;
+    break;
+
+  case 'J': // erase the whole console
+    if (p0 == 2) {
+      console_clear(self);
     }
+    break;
 
-    set_window(self, x, y, right, bottom);
-    DC_HIGH();
-    CS_LOW();
-    fill_color_buffer(self->spi_obj, color, w * h);
-    CS_HIGH();
+  case 'K': // erase to the end of the line
+    if (p0 == 0 && con->row < con->rows) {
+      console_erase(self, con->row, con->col, con->cols);
+    }
+    break;
   }
-  return mp_const_none;
 }
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_fill_rect_obj, 6, 6,
-                                           st7789_ST7789_fill_rect);
 
-static mp_obj_t st7789_ST7789_fill(mp_obj_t self_in, mp_obj_t _color) {
-  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
-  mp_int_t color = mp_obj_get_int(_color);
+static void console_put(st7789_ST7789_obj_t *self, uint8_t c) {
+  st7789_console_t *con = self->console;
 
-  set_window(self, 0, 0, self->width - 1, self->height - 1);
-  DC_HIGH();
-  CS_LOW();
-  fill_color_buffer(self->spi_obj, color, self->width * self->height);
-  CS_HIGH();
+  switch (con->state) {
+  case CONSOLE_ESC:
+    con->state = (c == '[') ? CONSOLE_CSI : CONSOLE_TEXT;
+    con->nparams = 0;
+    con->params[0] = 0;
+    return;
 
-  return mp_const_none;
-}
-static MP_DEFINE_CONST_FUN_OBJ_2(st7789_ST7789_fill_obj, st7789_ST7789_fill);
+  case CONSOLE_CSI:
+    if (c >= '0' && c <= '9') {
+      if (con->nparams == 0) {
+        con->nparams = 1;
+      }
+      uint16_t *p = &con->params[con->nparams - 1];
+      *p = MIN(*p * 10 + c - '0', 9999);
+    } else if (c == ';') {
+      if (con->nparams == 0) {
+        con->nparams = 1;
+      }
+      if (con->nparams < CONSOLE_MAX_PARAMS) {
+        con->params[con->nparams++] = 0;
+      }
+    } else if (c >= 0x40 && c <= 0x7E) {
+      console_csi(self, c);
+      con->state = CONSOLE_TEXT;
+    }
+    return;
+  }
 
-static void line(st7789_ST7789_obj_t *self, int16_t x0, int16_t y0, int16_t x1,
-                 int16_t y1, int16_t color) {
-  bool steep = ABS(y1 - y0) > ABS(x1 - x0);
-  if (steep) {
-    _swap_int16_t(x0, y0);
-    _swap_int16_t(x1, y1);
+  switch (c) {
+  case 0x1B:
+    con->state = CONSOLE_ESC;
+    break;
+
+  case '\n':
+    console_newline(self);
+    break;
+
+  case '\r':
+    con->col = 0;
+    break;
+
+  case '\b':
+    if (con->col > 0) {
+      con->col--;
+    }
+    break;
+
+  case '\t':
+    con->col = MIN((con->col + 8) & ~7, con->cols);
+    break;
+
+  default:
+    if (c >= ' ' && c != 0x7F) {
+      console_char(self, c);
+    }
+    break;
   }
+}
 
-  if (x0 > x1) {
-    _swap_int16_t(x0, x1);
-    _swap_int16_t(y0, y1);
+static mp_obj_t st7789_ST7789_console(size_t n_args, const mp_obj_t *args) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+  st7789_console_t *con = self->console;
+
+  if (n_args == 1) {
+    if (con != NULL) {
+      m_del(st7789_cell_t, con->cells, con->rows * con->cols);
+      m_del(st7789_console_t, con, 1);
+      self->console = NULL;
+      scroll_reset(self);
+    }
+    return mp_const_none;
   }
 
-  int16_t dx = x1 - x0, dy = ABS(y1 - y0);
-  int16_t err = dx >> 1, ystep = -1, xs = x0, dlen = 0;
+  st7789_bitmap_font_t font;
+  bitmap_font(args[1], &font);
+  mp_int_t fg = (n_args > 2) ? mp_obj_get_int(args[2]) : WHITE;
+  mp_int_t bg = (n_args > 3) ? mp_obj_get_int(args[3]) : BLACK;
+  mp_int_t top = (n_args > 4) ? mp_obj_get_int(args[4]) : 0;
+  mp_int_t bottom = (n_args > 5) ? mp_obj_get_int(args[5]) : 0;
 
-  if (y0 < y1) {
-    ystep = 1;
+  if (top < 0 || bottom < 0 || top + bottom + font.height > self->height ||
+      font.width > self->width) {
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid console area"));
   }
+  int rows = (self->height - top - bottom) / font.height;
+  int cols = self->width / font.width;
 
-  // Split into steep and not steep for FastH/V separation
-  if (steep) {
-    for (; x0 <= x1; x0++) {
-      dlen++;
-      err -= dy;
-      if (err < 0) {
-        err += dx;
-        if (dlen == 1) {
-          draw_pixel(self, y0, xs, color);
-        } else {
-          fast_vline(self, y0, xs, dlen, color);
-        }
-        dlen = 0;
-        y0 += ystep;
-        xs = x0 + 1;
-      }
-    }
-    if (dlen) {
-      fast_vline(self, y0, xs, dlen, color);
-    }
+  // rows left over below the last whole line join the bottom area
+  scroll_set(self, top, self->height - top - rows * font.height);
+
+  // allocate before freeing, a MemoryError must leave the old cells valid
+  st7789_cell_t *cells = m_new(st7789_cell_t, rows * cols);
+  if (con == NULL) {
+    con = self->console = m_new0(st7789_console_t, 1);
   } else {
-    for (; x0 <= x1; x0++) {
-      dlen++;
-      err -= dy;
-      if (err < 0) {
-        err += dx;
-        if (dlen == 1) {
-          draw_pixel(self, xs, y0, color);
-        } else {
-          fast_hline(self, xs, y0, dlen, color);
-        }
-        dlen = 0;
-        y0 += ystep;
-        xs = x0 + 1;
-      }
-    }
-    if (dlen) {
-      fast_hline(self, xs, y0, dlen, color);
-    }
+    m_del(st7789_cell_t, con->cells, con->rows * con->cols);
   }
+  con->cells = cells;
+  con->font_obj = args[1];
+  con->font = font;
+  con->cols = cols;
+  con->rows = rows;
+  con->first = 0;
+  con->top = top;
+  con->col = 0;
+  con->row = 0;
+  con->fg = CONSOLE_FG;
+  con->bg = CONSOLE_BG;
+  con->bold = false;
+  memcpy(con->colors, console_ansi, sizeof(console_ansi));
+  con->colors[CONSOLE_FG] = fg;
+  con->colors[CONSOLE_BG] = bg;
+  con->state = CONSOLE_TEXT;
+  con->dirty_end = con->dirty_start;
+  console_clear(self);
+  return mp_const_none;
 }
+static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_console_obj, 1, 6,
+                                           st7789_ST7789_console);
 
-static mp_obj_t st7789_ST7789_line(size_t n_args, const mp_obj_t *args) {
-  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
-  mp_int_t x0 = mp_obj_get_int(args[1]);
-  mp_int_t y0 = mp_obj_get_int(args[2]);
-  mp_int_t x1 = mp_obj_get_int(args[3]);
-  mp_int_t y1 = mp_obj_get_int(args[4]);
-  mp_int_t color = mp_obj_get_int(args[5]);
+static mp_obj_t st7789_ST7789_console_write(mp_obj_t self_in,
+                                            mp_obj_t text_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  st7789_console_t *con = self->console;
 
-  line(self, x0, y0, x1, y1, color);
+  // rotation() and scroll_area() take the scroll area away from the console
+  if (con == NULL || !self->scroll.active || self->scroll.top != con->top ||
+      self->scroll.rows != con->rows * con->font.height) {
+    mp_raise_msg(&mp_type_RuntimeError, MP_ERROR_TEXT("no console set"));
+  }
 
+  size_t len;
+  uint8_t chr;
+  const uint8_t *str = string_arg(text_in, &len, &chr);
+  for (size_t i = 0; i < len; i++) {
+    console_put(self, str[i]);
+  }
+  console_flush(self);
   return mp_const_none;
 }
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_line_obj, 6, 6,
-                                           st7789_ST7789_line);
+static MP_DEFINE_CONST_FUN_OBJ_2(st7789_ST7789_console_write_obj,
+                                 st7789_ST7789_console_write);
 
-static mp_obj_t st7789_ST7789_blit_buffer(size_t n_args, const mp_obj_t *args) {
-  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(args[0]);
-  mp_buffer_info_t buf_info;
-  mp_get_buffer_raise(args[1], &buf_info, MP_BUFFER_READ);
-  mp_int_t x = mp_obj_get_int(args[2]);
-  mp_int_t y = mp_obj_get_int(args[3]);
-  mp_int_t w = mp_obj_get_int(args[4]);
-  mp_int_t h = mp_obj_get_int(args[5]);
+//
+// Partial mode
+//
+// partial() limits the refresh of the panel to a band of rows and leaves the
+// rest of the display blank. PTLAR counts display memory rows like VSCRDEF,
+// so the band is turned around when MY is set and is only a band of logical
+// rows when MV is clear.
+//
 
-  set_window(self, x, y, x + w - 1, y + h - 1);
-  DC_HIGH();
-  CS_LOW();
+static void partial_send(st7789_ST7789_obj_t *self) {
+  int start = self->rowstart + self->partial_start;
+  int end = self->rowstart + self->partial_end;
+  if (self->madctl & ST7789_MADCTL_MY) {
+    int flipped = GRAM_ROWS - 1 - end;
+    end = GRAM_ROWS - 1 - start;
+    start = flipped;
+  }
+  uint8_t area[4] = {start >> 8, start & 0xFF, end >> 8, end & 0xFF};
+  write_cmd(self, ST7789_PTLAR, area, 4);
+  write_cmd(self, ST7789_PTLON, NULL, 0);
+}
 
-  const int buf_size = 256;
-  int limit = MIN(buf_info.len, w * h * 2);
-  int chunks = limit / buf_size;
-  int rest = limit % buf_size;
-  int i = 0;
-  for (; i < chunks; i++) {
-    write_spi(self->spi_obj, (const uint8_t *)buf_info.buf + i * buf_size,
-              buf_size);
+// keep the band on the same logical rows after a rotation or offset change,
+// landscape rotations return to normal mode
+static void partial_update(st7789_ST7789_obj_t *self) {
+  if (!self->partial) {
+    return;
   }
-  if (rest) {
-    write_spi(self->spi_obj, (const uint8_t *)buf_info.buf + i * buf_size,
-              rest);
+  if (self->madctl & ST7789_MADCTL_MV) {
+    self->partial = false;
+    write_cmd(self, ST7789_NORON, NULL, 0);
+  } else {
+    partial_send(self);
   }
-  CS_HIGH();
+}
+
+static mp_obj_t st7789_ST7789_partial(mp_obj_t self_in, mp_obj_t start_in,
+                                      mp_obj_t end_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  mp_int_t start = mp_obj_get_int(start_in);
+  mp_int_t end = mp_obj_get_int(end_in);
 
+  if (self->madctl & ST7789_MADCTL_MV) {
+    mp_raise_ValueError(
+        MP_ERROR_TEXT("partial mode needs a portrait rotation"));
+  }
+  if (start < 0 || start > end || end >= self->height) {
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid partial area"));
+  }
+  self->partial = true;
+  self->partial_start = start;
+  self->partial_end = end;
+  partial_send(self);
   return mp_const_none;
 }
-static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_blit_buffer_obj, 6, 6,
-                                           st7789_ST7789_blit_buffer);
+static MP_DEFINE_CONST_FUN_OBJ_3(st7789_ST7789_partial_obj,
+                                 st7789_ST7789_partial);
+
+static mp_obj_t st7789_ST7789_normal(mp_obj_t self_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  self->partial = false;
+  write_cmd(self, ST7789_NORON, NULL, 0);
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(st7789_ST7789_normal_obj,
+                                 st7789_ST7789_normal);
 
 // 0=Portrait, 1=Landscape, 2=Reverse Portrait (180), 3=Reverse Landscape (180)
 
 static void set_rotation(st7789_ST7789_obj_t *self) {
   uint8_t madctl_value = self->color_order;
 
+  // a queued show() reads from the frame buffer resized below
+  async_wait(self);
+
   if (self->rotation > self->rotations_len) {
     mp_raise_msg_varg(&mp_type_RuntimeError,
                       MP_ERROR_TEXT("Invalid rotation value %d > %d"),
@@ -620,14 +3851,34 @@ static void set_rotation(st7789_ST7789_obj_t *self) {
     self->rowstart = rotation->rowstart;
   }
 
+  if (self->frame_buffer &&
+      (size_t)(self->width * self->height) > self->frame_buffer_size) {
+    self->frame_buffer =
+        m_renew(uint16_t, self->frame_buffer, self->frame_buffer_size,
+                self->width * self->height);
+    self->frame_buffer_size = self->width * self->height;
+  }
+
+  self->dirty_cols =
+      (self->width + DIRTY_TILE_SIZE - 1) >> DIRTY_TILE_SHIFT;
+  self->dirty_rows =
+      (self->height + DIRTY_TILE_SIZE - 1) >> DIRTY_TILE_SHIFT;
+  if (self->dirty_cols > DIRTY_MAX_COLS) {
+    mp_raise_ValueError(MP_ERROR_TEXT("width too large for dirty tracking"));
+  }
+  if (self->dirty_rows > self->dirty_alloc) {
+    self->dirty =
+        m_renew(uint32_t, self->dirty, self->dirty_alloc, self->dirty_rows);
+    self->dirty_alloc = self->dirty_rows;
+  }
+
   self->madctl = madctl_value & 0xff;
-  self->min_x = self->width;
-  self->min_y = self->height;
-  self->max_x = 0;
-  self->max_y = 0;
+  clear_dirty(self);
 
   const uint8_t madctl[] = {madctl_value};
   write_cmd(self, ST7789_MADCTL, madctl, 1);
+  scroll_reset(self);
+  partial_update(self);
 }
 
 static mp_obj_t st7789_ST7789_rotation(mp_obj_t self_in, mp_obj_t value) {
@@ -680,10 +3931,47 @@ static mp_obj_t st7789_ST7789_vscsad(mp_obj_t self_in, mp_obj_t vssa_in) {
 static MP_DEFINE_CONST_FUN_OBJ_2(st7789_ST7789_vscsad_obj,
                                  st7789_ST7789_vscsad);
 
+// true if a bytes init sequence ends with a whole command
+static bool init_blob_valid(const uint8_t *data, size_t len) {
+  size_t pos = 0;
+  while (pos + 2 <= len) {
+    uint8_t n = data[pos + 1];
+    pos += 2 + (n & ~INIT_DELAY) + ((n & INIT_DELAY) ? 1 : 0);
+  }
+  return pos == len;
+}
+
+// send a bytes init sequence, checked again here as a bytearray may have
+// changed since the display was created
+static void init_blob(st7789_ST7789_obj_t *self, const uint8_t *data,
+                      size_t len) {
+  if (!init_blob_valid(data, len)) {
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid init sequence"));
+  }
+  size_t pos = 0;
+  while (pos < len) {
+    uint8_t cmd = data[pos];
+    uint8_t n = data[pos + 1];
+    size_t count = n & ~INIT_DELAY;
+    pos += 2;
+    write_cmd(self, cmd, count ? &data[pos] : NULL, count);
+    pos += count;
+    if (n & INIT_DELAY) {
+      mp_hal_delay_ms(data[pos++]);
+    }
+  }
+}
+
 static void custom_init(st7789_ST7789_obj_t *self) {
   size_t init_len;
   mp_obj_t *init_list;
 
+  mp_buffer_info_t blob_info;
+  if (mp_get_buffer(self->custom_init, &blob_info, MP_BUFFER_READ)) {
+    init_blob(self, blob_info.buf, blob_info.len);
+    return;
+  }
+
   mp_obj_get_array(self->custom_init, &init_len, &init_list);
 
   for (int idx = 0; idx < init_len; idx++) {
@@ -717,12 +4005,13 @@ static mp_obj_t st7789_ST7789_init(mp_obj_t self_in) {
   st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
   st7789_ST7789_hard_reset(self_in);
+  self->partial = false;
 
   if (self->custom_init == MP_OBJ_NULL) {
     st7789_ST7789_soft_reset(self_in);
     write_cmd(self, ST7789_SLPOUT, NULL, 0);
 
-    const uint8_t color_mode[] = {COLOR_MODE_65K | COLOR_MODE_16BIT};
+    const uint8_t color_mode[] = {COLOR_MODE_65K | self->color_mode};
     write_cmd(self, ST7789_COLMOD, color_mode, 1);
     mp_hal_delay_ms(10);
 
@@ -745,14 +4034,12 @@ static mp_obj_t st7789_ST7789_init(mp_obj_t self_in) {
   set_rotation(self);
   mp_hal_delay_ms(10);
 
-  const mp_obj_t args[] = {self_in,
-                           mp_obj_new_int(0),
-                           mp_obj_new_int(0),
-                           mp_obj_new_int(self->width),
-                           mp_obj_new_int(self->height),
-                           mp_obj_new_int(BLACK)};
-
-  st7789_ST7789_fill_rect(6, args);
+  if (self->clear) {
+    fill_rect(self, 0, 0, self->width, self->height, BLACK);
+    if (self->frame_buffer) {
+      show(self);
+    }
+  }
 
   if (self->backlight != GPIO_NUM_NC) {
     mp_hal_pin_write(self->backlight, 1);
@@ -808,6 +4095,10 @@ static mp_obj_t st7789_ST7789_offset(size_t n_args, const mp_obj_t *args) {
 
   self->colstart = colstart;
   self->rowstart = rowstart;
+  if (self->scroll.active) {
+    scroll_send(self);
+  }
+  partial_update(self);
 
   return mp_const_none;
 }
@@ -884,16 +4175,39 @@ static mp_obj_t st7789_ST7789_bounding(size_t n_args, const mp_obj_t *args) {
       self->bounding = 0;
     }
 
-    self->min_x = self->width;
-    self->min_y = self->height;
-    self->max_x = 0;
-    self->max_y = 0;
+    clear_dirty(self);
   }
   return mp_obj_new_tuple(4, bounds);
 }
 static MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(st7789_ST7789_bounding_obj, 1, 3,
                                            st7789_ST7789_bounding);
 
+#if ST7789_STATS
+static mp_obj_t st7789_ST7789_stats(mp_obj_t self_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  st7789_stats_t *stats = &self->stats;
+
+  mp_obj_t counters[7] = {
+      mp_obj_new_int_from_uint(stats->commands),
+      mp_obj_new_int_from_uint(stats->bytes - stats->commands),
+      mp_obj_new_int_from_uint(stats->spi_writes),
+      mp_obj_new_int_from_uint(stats->windows),
+      mp_obj_new_int_from_uint(stats->pixels_filled),
+      mp_obj_new_int_from_uint(stats->pixels_blitted),
+      mp_obj_new_int_from_uint(stats->transfer_us)};
+  return mp_obj_new_tuple(7, counters);
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(st7789_ST7789_stats_obj, st7789_ST7789_stats);
+
+static mp_obj_t st7789_ST7789_reset_stats(mp_obj_t self_in) {
+  st7789_ST7789_obj_t *self = MP_OBJ_TO_PTR(self_in);
+  memset(&self->stats, 0, sizeof(self->stats));
+  return mp_const_none;
+}
+static MP_DEFINE_CONST_FUN_OBJ_1(st7789_ST7789_reset_stats_obj,
+                                 st7789_ST7789_reset_stats);
+#endif
+
 static const mp_rom_map_elem_t st7789_ST7789_locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_write), MP_ROM_PTR(&st7789_ST7789_write_obj)},
     {MP_ROM_QSTR(MP_QSTR_hard_reset),
@@ -911,6 +4225,32 @@ static const mp_rom_map_elem_t st7789_ST7789_locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_off), MP_ROM_PTR(&st7789_ST7789_off_obj)},
     {MP_ROM_QSTR(MP_QSTR_pixel), MP_ROM_PTR(&st7789_ST7789_pixel_obj)},
     {MP_ROM_QSTR(MP_QSTR_line), MP_ROM_PTR(&st7789_ST7789_line_obj)},
+    {MP_ROM_QSTR(MP_QSTR_blit_rle), MP_ROM_PTR(&st7789_ST7789_blit_rle_obj)},
+    {MP_ROM_QSTR(MP_QSTR_blit_indexed),
+     MP_ROM_PTR(&st7789_ST7789_blit_indexed_obj)},
+    {MP_ROM_QSTR(MP_QSTR_blit_scaled),
+     MP_ROM_PTR(&st7789_ST7789_blit_scaled_obj)},
+    {MP_ROM_QSTR(MP_QSTR_blit_rotated),
+     MP_ROM_PTR(&st7789_ST7789_blit_rotated_obj)},
+    {MP_ROM_QSTR(MP_QSTR_blit_alpha),
+     MP_ROM_PTR(&st7789_ST7789_blit_alpha_obj)},
+    {MP_ROM_QSTR(MP_QSTR_fill_rect_alpha),
+     MP_ROM_PTR(&st7789_ST7789_fill_rect_alpha_obj)},
+    {MP_ROM_QSTR(MP_QSTR_fill_gradient),
+     MP_ROM_PTR(&st7789_ST7789_fill_gradient_obj)},
+    {MP_ROM_QSTR(MP_QSTR_fill_pattern),
+     MP_ROM_PTR(&st7789_ST7789_fill_pattern_obj)},
+    {MP_ROM_QSTR(MP_QSTR_jpg), MP_ROM_PTR(&st7789_ST7789_jpg_obj)},
+    {MP_ROM_QSTR(MP_QSTR_sprite), MP_ROM_PTR(&st7789_ST7789_sprite_obj)},
+    {MP_ROM_QSTR(MP_QSTR_move_sprite),
+     MP_ROM_PTR(&st7789_ST7789_move_sprite_obj)},
+    {MP_ROM_QSTR(MP_QSTR_hide_sprite),
+     MP_ROM_PTR(&st7789_ST7789_hide_sprite_obj)},
+    {MP_ROM_QSTR(MP_QSTR_sprite_background),
+     MP_ROM_PTR(&st7789_ST7789_sprite_background_obj)},
+    {MP_ROM_QSTR(MP_QSTR_update_sprites),
+     MP_ROM_PTR(&st7789_ST7789_update_sprites_obj)},
+    {MP_ROM_QSTR(MP_QSTR_png), MP_ROM_PTR(&st7789_ST7789_png_obj)},
     {MP_ROM_QSTR(MP_QSTR_blit_buffer),
      MP_ROM_PTR(&st7789_ST7789_blit_buffer_obj)},
     {MP_ROM_QSTR(MP_QSTR_set_window),
@@ -920,14 +4260,43 @@ static const mp_rom_map_elem_t st7789_ST7789_locals_dict_table[] = {
     {MP_ROM_QSTR(MP_QSTR_hline), MP_ROM_PTR(&st7789_ST7789_hline_obj)},
     {MP_ROM_QSTR(MP_QSTR_vline), MP_ROM_PTR(&st7789_ST7789_vline_obj)},
     {MP_ROM_QSTR(MP_QSTR_rect), MP_ROM_PTR(&st7789_ST7789_rect_obj)},
+    {MP_ROM_QSTR(MP_QSTR_pixels), MP_ROM_PTR(&st7789_ST7789_pixels_obj)},
+    {MP_ROM_QSTR(MP_QSTR_lines), MP_ROM_PTR(&st7789_ST7789_lines_obj)},
+    {MP_ROM_QSTR(MP_QSTR_rects), MP_ROM_PTR(&st7789_ST7789_rects_obj)},
+    {MP_ROM_QSTR(MP_QSTR_fill_rects),
+     MP_ROM_PTR(&st7789_ST7789_fill_rects_obj)},
+    {MP_ROM_QSTR(MP_QSTR_polygon), MP_ROM_PTR(&st7789_ST7789_polygon_obj)},
+    {MP_ROM_QSTR(MP_QSTR_text), MP_ROM_PTR(&st7789_ST7789_text_obj)},
+    {MP_ROM_QSTR(MP_QSTR_draw), MP_ROM_PTR(&st7789_ST7789_draw_obj)},
+    {MP_ROM_QSTR(MP_QSTR_draw_len), MP_ROM_PTR(&st7789_ST7789_draw_len_obj)},
+    {MP_ROM_QSTR(MP_QSTR_fill_polygon),
+     MP_ROM_PTR(&st7789_ST7789_fill_polygon_obj)},
     {MP_ROM_QSTR(MP_QSTR_rotation), MP_ROM_PTR(&st7789_ST7789_rotation_obj)},
     {MP_ROM_QSTR(MP_QSTR_width), MP_ROM_PTR(&st7789_ST7789_width_obj)},
     {MP_ROM_QSTR(MP_QSTR_height), MP_ROM_PTR(&st7789_ST7789_height_obj)},
     {MP_ROM_QSTR(MP_QSTR_vscrdef), MP_ROM_PTR(&st7789_ST7789_vscrdef_obj)},
     {MP_ROM_QSTR(MP_QSTR_vscsad), MP_ROM_PTR(&st7789_ST7789_vscsad_obj)},
+    {MP_ROM_QSTR(MP_QSTR_scroll_area),
+     MP_ROM_PTR(&st7789_ST7789_scroll_area_obj)},
+    {MP_ROM_QSTR(MP_QSTR_scroll), MP_ROM_PTR(&st7789_ST7789_scroll_obj)},
+    {MP_ROM_QSTR(MP_QSTR_console), MP_ROM_PTR(&st7789_ST7789_console_obj)},
+    {MP_ROM_QSTR(MP_QSTR_console_write),
+     MP_ROM_PTR(&st7789_ST7789_console_write_obj)},
+    {MP_ROM_QSTR(MP_QSTR_partial), MP_ROM_PTR(&st7789_ST7789_partial_obj)},
+    {MP_ROM_QSTR(MP_QSTR_normal), MP_ROM_PTR(&st7789_ST7789_normal_obj)},
     {MP_ROM_QSTR(MP_QSTR_madctl), MP_ROM_PTR(&st7789_ST7789_madctl_obj)},
     {MP_ROM_QSTR(MP_QSTR_offset), MP_ROM_PTR(&st7789_ST7789_offset_obj)},
     {MP_ROM_QSTR(MP_QSTR_bounding), MP_ROM_PTR(&st7789_ST7789_bounding_obj)},
+#if ST7789_STATS
+    {MP_ROM_QSTR(MP_QSTR_stats), MP_ROM_PTR(&st7789_ST7789_stats_obj)},
+    {MP_ROM_QSTR(MP_QSTR_reset_stats),
+     MP_ROM_PTR(&st7789_ST7789_reset_stats_obj)},
+#endif
+    {MP_ROM_QSTR(MP_QSTR_show), MP_ROM_PTR(&st7789_ST7789_show_obj)},
+    {MP_ROM_QSTR(MP_QSTR_dirty_rects),
+     MP_ROM_PTR(&st7789_ST7789_dirty_rects_obj)},
+    {MP_ROM_QSTR(MP_QSTR_busy), MP_ROM_PTR(&st7789_ST7789_busy_obj)},
+    {MP_ROM_QSTR(MP_QSTR_wait), MP_ROM_PTR(&st7789_ST7789_wait_obj)},
 };
 static MP_DEFINE_CONST_DICT(st7789_ST7789_locals_dict,
                             st7789_ST7789_locals_dict_table);
@@ -969,7 +4338,11 @@ mp_obj_t st7789_ST7789_make_new(const mp_obj_type_t *type, size_t n_args,
     ARG_color_order,
     ARG_inversion,
     ARG_options,
-    ARG_buffer_size
+    ARG_framebuffer,
+    ARG_buffer_size,
+    ARG_color_mode,
+    ARG_reset_delays,
+    ARG_clear
   };
   static const mp_arg_t allowed_args[] = {
       {MP_QSTR_spi, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_obj = MP_OBJ_NULL}},
@@ -989,6 +4362,17 @@ mp_obj_t st7789_ST7789_make_new(const mp_obj_type_t *type, size_t n_args,
        {.u_int = ST7789_MADCTL_RGB}},
       {MP_QSTR_inversion, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true}},
       {MP_QSTR_options, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0}},
+      {MP_QSTR_framebuffer, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = false}},
+      {MP_QSTR_buffer_size,
+       MP_ARG_KW_ONLY | MP_ARG_INT,
+       {.u_int = DEFAULT_BUFFER_SIZE}},
+      {MP_QSTR_color_mode,
+       MP_ARG_KW_ONLY | MP_ARG_INT,
+       {.u_int = COLOR_MODE_16BIT}},
+      {MP_QSTR_reset_delays,
+       MP_ARG_KW_ONLY | MP_ARG_OBJ,
+       {.u_obj = MP_OBJ_NULL}},
+      {MP_QSTR_clear, MP_ARG_KW_ONLY | MP_ARG_BOOL, {.u_bool = true}},
   };
   mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
   mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args),
@@ -1036,10 +4420,22 @@ mp_obj_t st7789_ST7789_make_new(const mp_obj_type_t *type, size_t n_args,
 
   self->rotation = args[ARG_rotation].u_int % self->rotations_len;
   self->custom_init = args[ARG_custom_init].u_obj;
+  mp_buffer_info_t blob_info;
+  if (self->custom_init != MP_OBJ_NULL &&
+      mp_get_buffer(self->custom_init, &blob_info, MP_BUFFER_READ) &&
+      !init_blob_valid(blob_info.buf, blob_info.len)) {
+    mp_raise_ValueError(MP_ERROR_TEXT("invalid init sequence"));
+  }
   self->color_order = args[ARG_color_order].u_int;
   self->inversion = args[ARG_inversion].u_bool;
   self->options = args[ARG_options].u_int & 0xff;
 
+  self->color_mode = args[ARG_color_mode].u_int;
+  if (self->color_mode != COLOR_MODE_16BIT &&
+      self->color_mode != COLOR_MODE_12BIT) {
+    mp_raise_ValueError(MP_ERROR_TEXT("unsupported color_mode"));
+  }
+
   if (args[ARG_dc].u_obj == MP_OBJ_NULL) {
     mp_raise_ValueError(MP_ERROR_TEXT("must specify dc pin"));
   }
@@ -1064,12 +4460,67 @@ mp_obj_t st7789_ST7789_make_new(const mp_obj_type_t *type, size_t n_args,
     self->backlight = GPIO_NUM_NC;
   }
 
+  self->reset_delays[0] = 50;
+  self->reset_delays[1] = 50;
+  self->reset_delays[2] = 150;
+  if (args[ARG_reset_delays].u_obj != MP_OBJ_NULL) {
+    mp_obj_t *delays;
+    mp_obj_get_array_fixed_n(args[ARG_reset_delays].u_obj, 3, &delays);
+    for (int i = 0; i < 3; i++) {
+      mp_int_t delay = mp_obj_get_int(delays[i]);
+      if (delay < 0 || delay > 0xFFFF) {
+        mp_raise_ValueError(MP_ERROR_TEXT("invalid reset_delays"));
+      }
+      self->reset_delays[i] = delay;
+    }
+  }
+  self->clear = args[ARG_clear].u_bool;
+
   self->bounding = 0;
   self->min_x = self->display_width;
   self->min_y = self->display_height;
   self->max_x = 0;
   self->max_y = 0;
 
+  self->dirty_cols =
+      (self->display_width + DIRTY_TILE_SIZE - 1) >> DIRTY_TILE_SHIFT;
+  self->dirty_rows =
+      (self->display_height + DIRTY_TILE_SIZE - 1) >> DIRTY_TILE_SHIFT;
+  self->dirty_alloc = MAX(self->dirty_cols, self->dirty_rows);
+  self->dirty = m_new(uint32_t, self->dirty_alloc);
+  memset(self->dirty, 0, self->dirty_alloc * sizeof(uint32_t));
+
+  memset(&self->window, 0, sizeof(self->window));
+  memset(&self->scroll, 0, sizeof(self->scroll));
+  self->partial = false;
+  // whole pixels only
+  mp_int_t buffer_size = args[ARG_buffer_size].u_int & ~1;
+  if (buffer_size < MIN_BUFFER_SIZE) {
+    mp_raise_ValueError(MP_ERROR_TEXT("buffer_size too small"));
+  }
+  self->buffer_size = buffer_size;
+  self->buffer = m_new(uint16_t, buffer_size / 2);
+
+  memset(&self->job, 0, sizeof(self->job));
+  self->job.data_obj = MP_OBJ_NULL;
+
+  self->sprites = NULL;
+  self->sprite_bg = BLACK;
+
+  self->console = NULL;
+
+#if ST7789_STATS
+  memset(&self->stats, 0, sizeof(self->stats));
+#endif
+
+  self->frame_buffer = NULL;
+  self->frame_buffer_size = 0;
+  if (args[ARG_framebuffer].u_bool) {
+    self->frame_buffer_size = self->display_width * self->display_height;
+    self->frame_buffer = m_new(uint16_t, self->frame_buffer_size);
+    memset(self->frame_buffer, 0, self->frame_buffer_size * 2);
+  }
+
   return MP_OBJ_FROM_PTR(self);
 }
 
@@ -1096,7 +4547,19 @@ static const mp_map_elem_t st7789_module_globals_table[] = {
     {MP_ROM_QSTR(MP_QSTR_BGR), MP_ROM_INT(ST7789_MADCTL_BGR)},
     {MP_ROM_QSTR(MP_QSTR_WRAP), MP_ROM_INT(OPTIONS_WRAP)},
     {MP_ROM_QSTR(MP_QSTR_WRAP_H), MP_ROM_INT(OPTIONS_WRAP_H)},
-    {MP_ROM_QSTR(MP_QSTR_WRAP_V), MP_ROM_INT(OPTIONS_WRAP_V)}};
+    {MP_ROM_QSTR(MP_QSTR_WRAP_V), MP_ROM_INT(OPTIONS_WRAP_V)},
+    {MP_ROM_QSTR(MP_QSTR_ASYNC), MP_ROM_INT(OPTIONS_ASYNC)},
+    {MP_ROM_QSTR(MP_QSTR_FLIP_X), MP_ROM_INT(TRANSFORM_FLIP_X)},
+    {MP_ROM_QSTR(MP_QSTR_FLIP_Y), MP_ROM_INT(TRANSFORM_FLIP_Y)},
+    {MP_ROM_QSTR(MP_QSTR_ROT90), MP_ROM_INT(TRANSFORM_ROT90)},
+    {MP_ROM_QSTR(MP_QSTR_ROT180), MP_ROM_INT(TRANSFORM_ROT180)},
+    {MP_ROM_QSTR(MP_QSTR_ROT270), MP_ROM_INT(TRANSFORM_ROT270)},
+    {MP_ROM_QSTR(MP_QSTR_GRADIENT_H), MP_ROM_INT(GRADIENT_H)},
+    {MP_ROM_QSTR(MP_QSTR_GRADIENT_V), MP_ROM_INT(GRADIENT_V)},
+    {MP_ROM_QSTR(MP_QSTR_DITHER), MP_ROM_INT(GRADIENT_DITHER)},
+    {MP_ROM_QSTR(MP_QSTR_INIT_DELAY), MP_ROM_INT(INIT_DELAY)},
+    {MP_ROM_QSTR(MP_QSTR_COLOR_MODE_16BIT), MP_ROM_INT(COLOR_MODE_16BIT)},
+    {MP_ROM_QSTR(MP_QSTR_COLOR_MODE_12BIT), MP_ROM_INT(COLOR_MODE_12BIT)}};
 
 static MP_DEFINE_CONST_DICT(mp_module_st7789_globals,
                             st7789_module_globals_table);
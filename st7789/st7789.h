@@ -65,6 +65,45 @@ extern "C" {
 #define OPTIONS_WRAP_V 0x01
 #define OPTIONS_WRAP_H 0x02
 #define OPTIONS_WRAP 0x03
+#define OPTIONS_ASYNC 0x04
+
+// blit_buffer() transforms, the flips are applied before the rotation
+#define TRANSFORM_FLIP_X 0x01 // mirror left to right
+#define TRANSFORM_FLIP_Y 0x02 // mirror top to bottom
+#define TRANSFORM_ROT90 0x04  // rotate 90 degrees counter-clockwise
+#define TRANSFORM_ROT180 (TRANSFORM_FLIP_X | TRANSFORM_FLIP_Y)
+#define TRANSFORM_ROT270 (TRANSFORM_ROT90 | TRANSFORM_ROT180)
+
+#define GRADIENT_H 0x00      // c0 at the left, c1 at the right
+#define GRADIENT_V 0x01      // c0 at the top, c1 at the bottom
+#define GRADIENT_DITHER 0x02 // 4x4 ordered dither between RGB565 steps
+
+// custom_init bytes: command, data length, data; a delay byte in ms follows
+// the data when the length has INIT_DELAY set
+#define INIT_DELAY 0x80
+
+#ifndef ST7789_STATS
+#define ST7789_STATS 1 // transfer counters for stats(), 0 leaves them out
+#endif
+
+#define DEFAULT_BUFFER_SIZE 1024 // bytes
+#define MIN_BUFFER_SIZE 64
+
+// dirty tracking tiles are 16x16 pixels, one bit per tile and one 32 bit
+// word per row of tiles
+#define DIRTY_TILE_SHIFT 4
+#define DIRTY_TILE_SIZE (1 << DIRTY_TILE_SHIFT)
+#define DIRTY_MAX_COLS 32
+
+#define MAX_SPRITES 32
+
+#define GRAM_COLS 240 // display memory columns
+#define GRAM_ROWS 320 // display memory rows, the axis VSCRDEF scrolls
+
+#define CONSOLE_COLORS 18 // 16 ANSI colors, then the default fg and bg
+#define CONSOLE_FG 16
+#define CONSOLE_BG 17
+#define CONSOLE_MAX_PARAMS 4 // numbers kept from an escape sequence
 
 typedef struct _st7789_rotation_t {
   uint8_t madctl;
@@ -74,6 +113,151 @@ typedef struct _st7789_rotation_t {
   uint16_t rowstart;
 } st7789_rotation_t;
 
+// address window state, used to skip CASET/RASET commands that would not
+// change anything and to stream pixels into an already open RAMWR
+typedef struct _st7789_window_t {
+  uint16_t caset[2]; // column range last sent, including colstart
+  uint16_t raset[2]; // row range last sent, including rowstart
+  bool caset_valid;  // caset matches the display register
+  bool raset_valid;  // raset matches the display register
+  bool open;         // RAMWR in progress and the write position is known
+  uint16_t x0, y0;   // open window, logical coordinates
+  uint16_t x1, y1;
+  uint16_t x, y; // next pixel the display will write
+
+  // a window that crosses the wrap of the scroll area is stored in up to
+  // four runs of display rows, sent one after the other
+  uint16_t segment_row[4];  // first row of each run, without rowstart
+  uint16_t segment_rows[4]; // rows in each run
+  uint16_t segment_width;   // pixels per row
+  uint8_t segments;         // runs in the window
+  uint8_t segment;          // run being written
+  size_t segment_left;      // bytes left in the run being written
+} st7789_window_t;
+
+// hardware scroll area in logical rows, rows between the fixed top and
+// bottom areas show the content offset rows further down, wrapping around
+typedef struct _st7789_scroll_t {
+  bool active;     // logical rows are translated through the offset
+  uint16_t top;    // rows fixed at the top
+  uint16_t bottom; // rows fixed at the bottom
+  uint16_t rows;   // rows in the scroll area
+  uint16_t offset; // rows the content has scrolled up, 0..rows - 1
+} st7789_scroll_t;
+
+// a transfer drained in steps from the MicroPython scheduler
+typedef struct _st7789_job_t {
+  mp_obj_t data_obj;   // keeps the source of a blit alive, or MP_OBJ_NULL
+  const uint8_t *data; // start of the current row, NULL for a solid fill
+  size_t row_len;      // bytes per row
+  size_t stride;       // bytes from the start of one row to the next
+  size_t offset;       // bytes of the current row already sent
+  size_t pattern;      // bytes of fill pattern in the scratch buffer
+  size_t rows;         // rows left to send, 0 when idle
+  bool scheduled;      // a step is queued with the scheduler
+} st7789_job_t;
+
+// pixels written in order into a window that may be partly off screen,
+// buffered in the transfer scratch buffer or stored in the frame buffer
+typedef struct _st7789_stream_t {
+  int x0, y0, x1, y1;     // requested window, logical coordinates
+  int cx0, cy0, cx1, cy1; // visible part of the window
+  int x, y;               // position of the next pixel
+  size_t len;             // pixels waiting in the scratch buffer
+  bool visible;           // some part of the window is on screen
+} st7789_stream_t;
+
+// palette of an indexed image, colors stored byte swapped ready to send
+typedef struct _st7789_palette_t {
+  uint16_t colors[256];
+  uint16_t nibbles[16][4]; // pixels of each nibble value at 1 and 2 bpp
+} st7789_palette_t;
+
+// compressed image source for the decoders and where the image goes
+typedef struct _st7789_image_io_t {
+  struct _st7789_ST7789_obj_t *self;
+  mp_obj_t file;       // stream to read from, MP_OBJ_NULL for in memory data
+  const uint8_t *data; // in memory image data
+  size_t len;
+  size_t pos;
+  int error; // stream error code, 0 if none
+  int x, y;  // display position of the top left corner
+  int bg;    // color transparent pixels are blended with, -1 to skip them
+  st7789_stream_t stream; // window of decoders that emit whole rows
+} st7789_image_io_t;
+
+// bitmap font module: FONT holds HEIGHT rows per glyph for the characters
+// FIRST..LAST, each row WIDTH bits rounded up to whole bytes, MSB first
+typedef struct _st7789_bitmap_font_t {
+  const uint8_t *glyphs;
+  uint8_t width;
+  uint8_t height;
+  uint8_t first;
+  uint8_t last;
+  size_t row_bytes;  // bytes per glyph row
+  size_t glyph_size; // bytes per glyph
+} st7789_bitmap_font_t;
+
+// RGB565 bitmap composited over the background by update_sprites()
+typedef struct _st7789_sprite_t {
+  mp_obj_t data_obj;   // keeps the bitmap alive, MP_OBJ_NULL for a free slot
+  const uint8_t *data; // big endian RGB565 pixels
+  uint16_t width;
+  uint16_t height;
+  int32_t key;       // transparent color, byte swapped, -1 for none
+  int16_t x, y;      // position to draw at
+  int16_t drawn_x;   // area the sprite is shown in on the display
+  int16_t drawn_y;
+  uint16_t drawn_width;
+  uint16_t drawn_height;
+  int8_t z;          // stacking order, higher is on top
+  bool visible;      // drawn at the next update
+  bool drawn;        // shown on the display
+  bool changed;      // needs drawing at the next update
+} st7789_sprite_t;
+
+// character cell of the console, colors index st7789_console_t colors
+typedef struct _st7789_cell_t {
+  uint8_t c; // ' ' for a blank cell
+  uint8_t fg;
+  uint8_t bg;
+} st7789_cell_t;
+
+// text console in the scroll area, lines scroll up with VSCSAD
+typedef struct _st7789_console_t {
+  mp_obj_t font_obj; // keeps the font alive
+  st7789_bitmap_font_t font;
+  st7789_cell_t *cells; // rows * cols cells, a ring of rows
+  uint16_t cols;
+  uint16_t rows;
+  uint16_t first; // cells row shown at the top of the console
+  uint16_t top;   // display row of the first line
+  uint16_t col;   // cursor, col == cols when the next character wraps
+  uint16_t row;   // row == rows when the next character scrolls
+  uint8_t fg; // colors of new characters
+  uint8_t bg;
+  bool bold;
+  uint16_t colors[CONSOLE_COLORS];
+  uint8_t state; // escape sequence parser state
+  uint8_t nparams;
+  uint16_t params[CONSOLE_MAX_PARAMS];
+  uint16_t dirty_row; // cells changed since the console was last drawn
+  uint16_t dirty_start;
+  uint16_t dirty_end; // dirty_start when there are none
+} st7789_console_t;
+
+#if ST7789_STATS
+typedef struct _st7789_stats_t {
+  uint32_t commands;       // command bytes sent
+  uint32_t bytes;          // all bytes sent, commands included
+  uint32_t spi_writes;     // calls to the SPI transfer
+  uint32_t windows;        // address windows set
+  uint32_t pixels_filled;  // pixels sent by solid fills
+  uint32_t pixels_blitted; // pixels sent from buffers and streams
+  uint32_t transfer_us;    // time spent in SPI transfers
+} st7789_stats_t;
+#endif
+
 // this is the actual C-structure for our new object
 typedef struct _st7789_ST7789_obj_t {
   mp_obj_base_t base;
@@ -89,8 +273,9 @@ typedef struct _st7789_ST7789_obj_t {
   st7789_rotation_t
       *rotations; // list of rotation tuples [(madctl, colstart, rowstart)]
   uint8_t rotations_len; // number of rotations
-  mp_obj_t custom_init;  // custom init sequence
+  mp_obj_t custom_init;  // custom init sequence, list or bytes
   uint8_t color_order;
+  uint8_t color_mode; // COLOR_MODE_16BIT or COLOR_MODE_12BIT transfers
   bool inversion;
   uint8_t madctl;
   uint8_t options; // options bit array
@@ -98,12 +283,41 @@ typedef struct _st7789_ST7789_obj_t {
   mp_hal_pin_obj_t dc;
   mp_hal_pin_obj_t cs;
   mp_hal_pin_obj_t backlight;
+  uint16_t reset_delays[3]; // ms before, during and after the reset pulse
+  bool clear;               // init() clears the display
+
+  st7789_window_t window; // address window cache
+  st7789_scroll_t scroll; // scroll area set by scroll_area()
+  bool partial;           // partial mode set by partial()
+  uint16_t partial_start; // first and last logical rows of the partial area
+  uint16_t partial_end;
 
   uint8_t bounding;
   uint16_t min_x;
   uint16_t min_y;
   uint16_t max_x;
   uint16_t max_y;
+  uint32_t *dirty;     // dirty tile bitmap, one word per row of tiles
+  uint8_t dirty_rows;  // rows of tiles for the current rotation
+  uint8_t dirty_cols;  // columns of tiles for the current rotation
+  uint8_t dirty_alloc; // number of words allocated for dirty
+
+  uint16_t *frame_buffer;   // RGB565 shadow of the display, NULL if disabled
+  size_t frame_buffer_size; // frame buffer size in pixels
+
+  uint16_t *buffer;   // transfer scratch buffer shared by fills and blits
+  size_t buffer_size; // scratch buffer size in bytes
+
+  st7789_job_t job; // pending asynchronous transfer
+
+  st7789_sprite_t *sprites; // MAX_SPRITES slots, NULL until the first sprite
+  uint16_t sprite_bg;       // color behind sprites without a frame buffer
+
+  st7789_console_t *console; // NULL until console() is called
+
+#if ST7789_STATS
+  st7789_stats_t stats; // cleared by reset_stats()
+#endif
 
 } st7789_ST7789_obj_t;
 